@@ -0,0 +1,394 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <err.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cvmx.h>
+#include <cvmx-lmcx-defs.h>
+
+#include "apply.h"
+#include "cores.h"
+#include "host.h"
+#include "target.h"
+
+#ifndef	howmany
+#define	howmany(a)	(sizeof (a) / sizeof *(a))
+#endif
+
+#define	APPLY_FNV_BASIS		(0xcbf29ce484222325ull)
+#define	APPLY_FNV_PRIME		(0x00000100000001b3ull)
+
+static bool target_apply_one(struct target *, const struct apply_state *, unsigned, bool);
+static struct apply_state *apply_section(struct apply_state **, unsigned *);
+static void apply_image(struct apply_state *, const char *);
+static uint64_t apply_number(const char *, unsigned long, const char *, const char *);
+
+/*
+ * Parse a state file, one statement per line:
+ *
+ *	target target-list	following statements apply to these targets
+ *	board type		the board type each must have
+ *	image path address [version]
+ *				memory contents each must have been loaded with
+ *	cores mask		the cores each must have running
+ *
+ * Statements before the first target line apply to all targets.
+ * Blank lines and anything following a # are ignored.
+ */
+void
+apply_parse(const char *path, const struct target_selector *all, struct apply_state **statesp, unsigned *nstatesp)
+{
+	struct apply_state *as, *states;
+	unsigned nstates, ntoks;
+	char *line, *p, *toks[4];
+	unsigned long lineno;
+	size_t linesize;
+	uint64_t value;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		err(1, "fopen %s", path);
+
+	states = NULL;
+	nstates = 0;
+	as = apply_section(&states, &nstates);
+	target_selector_copy(as->as_targets, all);
+
+	line = NULL;
+	linesize = 0;
+	lineno = 0;
+	while (getline(&line, &linesize, fp) != -1) {
+		lineno++;
+		p = strchr(line, '#');
+		if (p != NULL)
+			*p = '\0';
+
+		ntoks = 0;
+		for (p = strtok(line, " \t\n"); p != NULL; p = strtok(NULL, " \t\n")) {
+			if (ntoks == howmany(toks))
+				errx(1, "%s:%lu: too many words.", path, lineno);
+			toks[ntoks++] = p;
+		}
+		if (ntoks == 0)
+			continue;
+
+		if (strcmp(toks[0], "target") == 0) {
+			if (ntoks != 2)
+				errx(1, "%s:%lu: expected \"target target-list\".", path, lineno);
+			as = apply_section(&states, &nstates);
+			target_selector_parse(as->as_targets, all, toks[1]);
+			continue;
+		}
+
+		as = &states[nstates - 1];
+		if (strcmp(toks[0], "board") == 0) {
+			if (ntoks != 2)
+				errx(1, "%s:%lu: expected \"board type\".", path, lineno);
+			value = apply_number(path, lineno, toks[1], "board type");
+			if (value > UINT16_MAX)
+				errx(1, "%s:%lu: invalid board type: %s", path, lineno, toks[1]);
+			as->as_board_set = true;
+			as->as_board = value;
+		} else if (strcmp(toks[0], "image") == 0) {
+			if (ntoks != 3 && ntoks != 4)
+				errx(1, "%s:%lu: expected \"image path address [version]\".", path, lineno);
+			as->as_image_addr = apply_number(path, lineno, toks[2], "address");
+			as->as_image_stamp = 0;
+			if (ntoks == 4) {
+				as->as_image_stamp = apply_number(path, lineno, toks[3], "version");
+				if (as->as_image_stamp == 0)
+					errx(1, "%s:%lu: version must be non-zero.", path, lineno);
+			}
+			apply_image(as, toks[1]);
+		} else if (strcmp(toks[0], "cores") == 0) {
+			if (ntoks != 2)
+				errx(1, "%s:%lu: expected \"cores mask\".", path, lineno);
+			as->as_cores_set = true;
+			as->as_cores = apply_number(path, lineno, toks[1], "core mask");
+		} else {
+			errx(1, "%s:%lu: unknown statement: %s", path, lineno, toks[0]);
+		}
+	}
+	if (ferror(fp))
+		err(1, "read %s", path);
+	free(line);
+	fclose(fp);
+
+	*statesp = states;
+	*nstatesp = nstates;
+}
+
+void
+target_apply_run(struct target **targets, unsigned n, const struct apply_state *states, unsigned nstates, bool dryrun)
+{
+	unsigned failed, i;
+	pid_t *pids;
+	int status;
+
+	failed = 0;
+
+	if (dryrun || n == 1) {
+		for (i = 0; i < n; i++)
+			if (!target_apply_one(targets[i], states, nstates, dryrun))
+				failed++;
+	} else {
+		pids = calloc(n, sizeof *pids);
+		if (pids == NULL)
+			err(1, "calloc");
+
+		fflush(stdout);
+		fflush(stderr);
+		for (i = 0; i < n; i++) {
+			pids[i] = fork();
+			if (pids[i] == -1)
+				err(1, "fork");
+			if (pids[i] == 0) {
+				setvbuf(stdout, NULL, _IOLBF, 0);
+				exit(target_apply_one(targets[i], states, nstates, false) ? 0 : 1);
+			}
+		}
+
+		for (i = 0; i < n; i++) {
+			while (waitpid(pids[i], &status, 0) == -1) {
+				if (errno != EINTR)
+					err(1, "waitpid");
+			}
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+				warnx("target%u: not brought to desired state.", targets[i]->t_unit);
+				failed++;
+			}
+		}
+		free(pids);
+	}
+
+	if (failed != 0)
+		exit(1);
+}
+
+/*
+ * Work out what must change on a target, reading its current state
+ * in one batch, and unless this is a dry run, make those changes.
+ * Before an image is loaded, every running core is held in reset, so
+ * that none runs from memory as it is being overwritten.
+ */
+static bool
+target_apply_one(struct target *t, const struct apply_state *states, unsigned nstates, bool dryrun)
+{
+	struct target_cores_req tcr;
+	const struct apply_state *image;
+	uint64_t addrs[2], vals[2];
+	uint64_t hold, release, running, stamp, want;
+	cvmx_lmcx_reset_ctl_t lrc;
+	const char *verb;
+	bool board_set;
+	uint16_t board;
+	unsigned i;
+
+	verb = dryrun ? "would " : "";
+
+	addrs[0] = t->t_csrs.tc_ciu_pp_rst;
+	addrs[1] = t->t_csrs.tc_lmc_reset_ctl;
+	target_read_csr_batch(t, addrs, vals, howmany(addrs));
+	running = t->t_core_mask & ~vals[0];
+	lrc.u64 = vals[1];
+	stamp = target_read_sli(t, t->t_csrs.tc_sli_scratch_1);
+
+	/*
+	 * Nothing is loaded while memory is held in reset, whatever
+	 * the stamp says; it may have been left by a previous boot.
+	 */
+	if (!lrc.s.ddr3rst)
+		stamp = 0;
+
+	board_set = false;
+	board = 0;
+	image = NULL;
+	want = running;
+	for (i = 0; i < nstates; i++) {
+		if (!TARGET_SELECTED(states[i].as_targets, t->t_unit))
+			continue;
+		if (states[i].as_board_set) {
+			board_set = true;
+			board = states[i].as_board;
+		}
+		if (states[i].as_image != NULL)
+			image = &states[i];
+		if (states[i].as_cores_set)
+			want = states[i].as_cores;
+	}
+
+	if (board_set && t->t_board_type != board) {
+		printf("target%u: board type 0x%04hx, expected 0x%04hx\n", t->t_unit, t->t_board_type, board);
+		return (false);
+	}
+	if ((want & ~t->t_core_mask) != 0) {
+		printf("target%u: cores 0x%016jx not within core mask 0x%016jx\n", t->t_unit, (uintmax_t)want, (uintmax_t)t->t_core_mask);
+		return (false);
+	}
+	if (image != NULL && image->as_image_stamp == stamp)
+		image = NULL;
+	if (image != NULL && !lrc.s.ddr3rst) {
+		printf("target%u: memory not available to load %s, and boot is not supported\n", t->t_unit, image->as_image);
+		return (false);
+	}
+
+	if (image != NULL) {
+		hold = running;
+		release = want;
+	} else {
+		hold = running & ~want;
+		release = want & ~running;
+	}
+
+	/*
+	 * Cores released after an image is loaded start at the reset
+	 * vector, and only a boot stub there can send them to it.
+	 */
+	if (image != NULL && release != 0 && !target_cores_stub_enabled(t)) {
+		printf("target%u: no boot stub enabled in MIO_BOOT_LOC_CFG0 to start %s\n", t->t_unit, image->as_image);
+		return (false);
+	}
+
+	if (hold == 0 && image == NULL && release == 0) {
+		printf("target%u: up to date\n", t->t_unit);
+		return (true);
+	}
+
+	memset(&tcr, 0, sizeof tcr);
+	if (hold != 0) {
+		printf("target%u: %shold cores 0x%016jx\n", t->t_unit, verb, (uintmax_t)hold);
+		if (!dryrun) {
+			tcr.tcr_op = TARGET_CORES_RESET;
+			tcr.tcr_mask = hold;
+			target_cores_run(t, &tcr);
+		}
+	}
+	if (image != NULL) {
+		printf("target%u: %sload %s (%zu bytes) at %#jx\n", t->t_unit, verb, image->as_image, image->as_image_len, (uintmax_t)image->as_image_addr);
+		if (!dryrun) {
+			target_mem_write(t, image->as_image_addr, image->as_image_data, image->as_image_len);
+			target_write_sli(t, t->t_csrs.tc_sli_scratch_1, image->as_image_stamp);
+		}
+	}
+	if (release != 0) {
+		printf("target%u: %srelease cores 0x%016jx\n", t->t_unit, verb, (uintmax_t)release);
+		if (!dryrun) {
+			tcr.tcr_op = TARGET_CORES_RELEASE;
+			tcr.tcr_mask = release;
+			target_cores_run(t, &tcr);
+		}
+	}
+	return (true);
+}
+
+static struct apply_state *
+apply_section(struct apply_state **statesp, unsigned *nstatesp)
+{
+	struct apply_state *as, *states;
+
+	states = reallocarray(*statesp, *nstatesp + 1, sizeof *states);
+	if (states == NULL)
+		err(1, "reallocarray");
+	as = &states[(*nstatesp)++];
+	*statesp = states;
+
+	memset(as, 0, sizeof *as);
+	as->as_targets = malloc(sizeof *as->as_targets);
+	if (as->as_targets == NULL)
+		err(1, "malloc");
+	target_selector_init(as->as_targets);
+	return (as);
+}
+
+/*
+ * Read an image into memory and, unless a version was given, derive
+ * the stamp which records that it has been loaded from its contents.
+ * A stamp of zero is what target_reset_one leaves, so is never used.
+ */
+static void
+apply_image(struct apply_state *as, const char *path)
+{
+	struct stat st;
+	uint64_t hash;
+	size_t i;
+	FILE *fp;
+
+	free(as->as_image);
+	free(as->as_image_data);
+
+	as->as_image = strdup(path);
+	if (as->as_image == NULL)
+		err(1, "strdup");
+
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		err(1, "fopen %s", path);
+	if (fstat(fileno(fp), &st) == -1)
+		err(1, "fstat %s", path);
+	if (st.st_size <= 0)
+		errx(1, "%s: empty image.", path);
+
+	as->as_image_len = st.st_size;
+	as->as_image_data = malloc(as->as_image_len);
+	if (as->as_image_data == NULL)
+		err(1, "malloc");
+	if (fread(as->as_image_data, 1, as->as_image_len, fp) != as->as_image_len)
+		errx(1, "%s: short read.", path);
+	fclose(fp);
+
+	if (as->as_image_stamp != 0)
+		return;
+
+	hash = APPLY_FNV_BASIS;
+	for (i = 0; i < as->as_image_len; i++) {
+		hash ^= as->as_image_data[i];
+		hash *= APPLY_FNV_PRIME;
+	}
+	as->as_image_stamp = hash == 0 ? 1 : hash;
+}
+
+static uint64_t
+apply_number(const char *path, unsigned long lineno, const char *s, const char *what)
+{
+	unsigned long long n;
+	char *end;
+
+	errno = 0;
+	n = strtoull(s, &end, 0);
+	if (*s == '\0' || *end != '\0' || errno != 0)
+		errx(1, "%s:%lu: invalid %s: %s", path, lineno, what, s);
+	return (n);
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#ifndef	APPLY_H
+#define	APPLY_H
+
+struct target;
+struct target_selector;
+
+/*
+ * The desired state of a set of targets, as given by one section of
+ * a state file.  Only the fields which are set are checked, and where
+ * sections overlap, later ones override earlier ones.
+ *
+ * An image is loaded only if the stamp recorded in SLI_SCRATCH_1 when
+ * it was last loaded differs from as_image_stamp, which is either the
+ * version given for it or a hash of its contents.  SLI_SCRATCH_1
+ * survives a chip reset, so the reset command clears it, and any stamp
+ * is ignored while memory is held in reset; either way the image is
+ * loaded again.
+ *
+ * Loading an image holds every running core while memory is written.
+ * Released cores start at the reset vector, so the cores are only
+ * released again if a boot stub is enabled to send them on to the
+ * image; otherwise the target is refused before anything is done.
+ */
+struct apply_state {
+	struct target_selector *as_targets;
+
+	bool as_board_set;
+	uint16_t as_board;		/* Expected board type.  */
+
+	char *as_image;			/* Path, or NULL for none.  */
+	uint8_t *as_image_data;
+	size_t as_image_len;
+	uint64_t as_image_addr;
+	uint64_t as_image_stamp;
+
+	bool as_cores_set;
+	uint64_t as_cores;		/* Cores to be running.  */
+};
+
+void apply_parse(const char *, const struct target_selector *, struct apply_state **, unsigned *);
+
+/*
+ * Bring each target to its desired state, doing only what is needed,
+ * with a process for each target so that slow loads overlap.  With
+ * dry-run set, only print what would be done.  Exits if any target
+ * could not be brought to its desired state.
+ */
+void target_apply_run(struct target **, unsigned, const struct apply_state *, unsigned, bool);
+
+#endif /* !APPLY_H */
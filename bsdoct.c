@@ -24,40 +24,80 @@
  */
 
 #include <sys/types.h>
+#include <ctype.h>
 #include <err.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "apply.h"
+#include "cores.h"
+#include "csr.h"
+#include "dma.h"
+#include "host.h"
+#include "mbox.h"
 #include "target.h"
+#include "timing.h"
+#include "twsi.h"
 
+static size_t parse_bytes(uint8_t *, size_t, const char *, const char *);
+static void parse_message(struct mbox_msg *, uint32_t, const char *);
+static uint64_t parse_number(const char *, const char *);
 static void usage(void);
 
 int
 main(int argc, char *argv[])
 {
 	struct target_selector all, selected;
-	unsigned n;
+	struct apply_state *states;
+	struct target_cores_req tcr;
+	struct twsi_op to;
+	struct mbox_msg *msgs;
+	struct csr_op *ops;
+	const char **selectors, *path, *prefix;
+	uint64_t interval, samples, value;
+	unsigned i, n, nops, nselectors, nstates;
+	bool dryrun, select_all;
 	int ch;
 
-	TARGET_SELECTOR_CLEAR(&selected);
+	target_selector_init(&all);
+	target_selector_init(&selected);
 
-	all = target_identify();
-	if (TARGET_SELECTOR_EMPTY(&all))
-		errx(1, "no targets identified.");
+	select_all = false;
+	selectors = NULL;
+	nselectors = 0;
 
-	while ((ch = getopt(argc, argv, "as:")) != -1) {
+	while ((ch = getopt(argc, argv, "aD:s:T:w")) != -1) {
 		switch (ch) {
 		case 'a':
-			selected = all;
+			select_all = true;
+			break;
+		case 'D':
+			target_dma_scratch = parse_number(optarg, "DMA scratch address");
+			if (target_dma_scratch == 0 ||
+			    target_dma_scratch % TARGET_DMA_SCRATCH_SIZE != 0)
+				errx(1, "DMA scratch address must be non-zero and %u-byte aligned.", TARGET_DMA_SCRATCH_SIZE);
 			break;
 		case 's':
-			n = atoi(optarg);
-			if (!TARGET_SELECTED(&all, n))
-				errx(1, "target%u not present.", n);
-			TARGET_SELECT(&selected, n);
+			selectors = reallocarray(selectors, nselectors + 1, sizeof *selectors);
+			if (selectors == NULL)
+				err(1, "reallocarray");
+			selectors[nselectors++] = optarg;
+			break;
+		case 'T':
+			if (strcmp(optarg, "text") == 0)
+				timing_format = TIMING_TEXT;
+			else if (strcmp(optarg, "json") == 0)
+				timing_format = TIMING_JSON;
+			else
+				errx(1, "invalid timing format: %s", optarg);
+			break;
+		case 'w':
+			target_bar1_write_combining = true;
 			break;
 		default:
 			usage();
@@ -66,17 +106,25 @@ main(int argc, char *argv[])
 	argc -= optind;
 	argv += optind;
 
+	target_identify(&all);
+	if (TARGET_SELECTOR_EMPTY(&all))
+		errx(1, "no targets identified.");
+
+	for (i = 0; i < nselectors; i++)
+		target_selector_parse(&selected, &all, selectors[i]);
+	free(selectors);
+	if (select_all)
+		target_selector_copy(&selected, &all);
+
 	if (TARGET_SELECTED_COUNT(&all) == 1 &&
 	    TARGET_SELECTOR_EMPTY(&selected))
-		selected = all;
+		target_selector_copy(&selected, &all);
 
 	if (TARGET_SELECTOR_EMPTY(&selected)) {
 		if (argc == 0) {
 			printf("targets present:");
-			for (n = 0; n < TARGET_SELECTOR_COUNT; n++) {
-				if (TARGET_SELECTED(&all, n))
-					printf(" %u", n);
-			}
+			TARGET_SELECTOR_FOREACH(&all, n)
+				printf(" %u", n);
 			printf("\n");
 			return (0);
 		}
@@ -84,9 +132,23 @@ main(int argc, char *argv[])
 	}
 
 	if (argc == 0 || strcmp(argv[0], "show") == 0) {
-		if (argc > 1)
+		if (argc > 2 || (argc == 2 && strcmp(argv[1], "-b") != 0))
+			usage();
+		target_show(&selected, argc == 2);
+		return (0);
+	}
+
+	if (strcmp(argv[0], "apply") == 0) {
+		dryrun = false;
+		if (argc == 3 && strcmp(argv[1], "-n") == 0) {
+			dryrun = true;
+			argc--;
+			argv++;
+		}
+		if (argc != 2)
 			usage();
-		target_show(&selected);
+		apply_parse(argv[1], &all, &states, &nstates);
+		target_apply(&selected, states, nstates, dryrun);
 		return (0);
 	}
 
@@ -97,12 +159,166 @@ main(int argc, char *argv[])
 		return (0);
 	}
 
+	if (strcmp(argv[0], "call") == 0) {
+		if (argc < 2)
+			usage();
+		msgs = calloc(argc - 1, sizeof *msgs);
+		if (msgs == NULL)
+			err(1, "calloc");
+		for (i = 1; i < (unsigned)argc; i++)
+			parse_message(&msgs[i - 1], i - 1, argv[i]);
+		target_call(&selected, msgs, argc - 1);
+		free(msgs);
+		return (0);
+	}
+
 	if (strcmp(argv[0], "console") == 0) {
+		prefix = NULL;
+		if (argc >= 3 && strcmp(argv[1], "-o") == 0) {
+			prefix = argv[2];
+			argc -= 2;
+			argv += 2;
+		}
+		if (argc > 2)
+			usage();
+		if (prefix == NULL && TARGET_SELECTED_COUNT(&selected) != 1)
+			errx(1, "must select exactly one target for console without -o.");
+		target_console(&selected,
+		    argc == 2 ? parse_number(argv[1], "console number") : 0,
+		    prefix);
+		return (0);
+	}
+
+	if (strcmp(argv[0], "cores") == 0) {
+		if (argc < 3)
+			usage();
+		memset(&tcr, 0, sizeof tcr);
+		if (strcmp(argv[1], "reset") == 0)
+			tcr.tcr_op = TARGET_CORES_RESET;
+		else if (strcmp(argv[1], "release") == 0)
+			tcr.tcr_op = TARGET_CORES_RELEASE;
+		else if (strcmp(argv[1], "debug") == 0)
+			tcr.tcr_op = TARGET_CORES_DEBUG;
+		else if (strcmp(argv[1], "restart") == 0)
+			tcr.tcr_op = TARGET_CORES_RESTART;
+		else
+			usage();
+		argc--;
+		argv++;
+
+		tcr.tcr_delay = 100;
+		while (tcr.tcr_op == TARGET_CORES_RESTART && argc >= 3 &&
+		    argv[1][0] == '-') {
+			if (strcmp(argv[1], "-g") == 0) {
+				value = parse_number(argv[2], "group size");
+				if (value == 0 || value > 64)
+					errx(1, "invalid group size: %s", argv[2]);
+				tcr.tcr_group = value;
+			} else if (strcmp(argv[1], "-d") == 0) {
+				value = parse_number(argv[2], "delay");
+				if (value > 3600 * 1000)
+					errx(1, "invalid delay: %s", argv[2]);
+				tcr.tcr_delay = value;
+			} else {
+				usage();
+			}
+			argc -= 2;
+			argv += 2;
+		}
+		if (argc != 2)
+			usage();
+		tcr.tcr_mask = parse_number(argv[1], "core mask");
+		target_cores(&selected, &tcr);
+		return (0);
+	}
+
+	if (strcmp(argv[0], "csr") == 0) {
+		if (argc < 2)
+			usage();
+		if (strcmp(argv[1], "-f") == 0) {
+			if (argc != 3)
+				usage();
+			csr_script(argv[2], &ops, &nops);
+		} else if (strcmp(argv[1], "read") == 0) {
+			if (argc < 3)
+				usage();
+			nops = argc - 2;
+			ops = calloc(nops, sizeof *ops);
+			if (ops == NULL)
+				err(1, "calloc");
+			for (i = 0; i < nops; i++)
+				csr_parse(&ops[i], argv[i + 2], NULL);
+		} else if (strcmp(argv[1], "write") == 0) {
+			if (argc != 4)
+				usage();
+			nops = 1;
+			ops = calloc(nops, sizeof *ops);
+			if (ops == NULL)
+				err(1, "calloc");
+			csr_parse(&ops[0], argv[2], argv[3]);
+		} else {
+			usage();
+		}
+		target_csr(&selected, ops, nops);
+		free(ops);
+		return (0);
+	}
+
+	if (strcmp(argv[0], "fuses") == 0) {
 		if (argc != 1)
 			usage();
+		target_fuses(&selected);
+		return (0);
+	}
+
+	if (strcmp(argv[0], "mem") == 0) {
+		if (argc < 2)
+			usage();
 		if (TARGET_SELECTED_COUNT(&selected) != 1)
-			errx(1, "must select exactly one target for console.");
-		//target_console(&selected);
+			errx(1, "must select exactly one target for mem.");
+		if (strcmp(argv[1], "read") == 0) {
+			if (argc != 4 && argc != 5)
+				usage();
+			target_mem_dump(&selected,
+			    parse_number(argv[2], "address"),
+			    parse_number(argv[3], "length"),
+			    argc == 5 ? argv[4] : NULL);
+			return (0);
+		}
+		if (strcmp(argv[1], "write") == 0) {
+			if (argc != 4)
+				usage();
+			target_mem_load(&selected,
+			    parse_number(argv[2], "address"), argv[3]);
+			return (0);
+		}
+		usage();
+	}
+
+	if (strcmp(argv[0], "profile") == 0) {
+		interval = 100;
+		samples = 0;
+		path = NULL;
+		while (argc >= 3 && argv[1][0] == '-') {
+			if (strcmp(argv[1], "-i") == 0) {
+				interval = parse_number(argv[2], "interval");
+				if (interval == 0 || interval > 3600 * 1000)
+					errx(1, "invalid interval: %s", argv[2]);
+			} else if (strcmp(argv[1], "-n") == 0) {
+				samples = parse_number(argv[2], "sample count");
+				if (samples > UINT_MAX)
+					errx(1, "invalid sample count: %s", argv[2]);
+			} else if (strcmp(argv[1], "-o") == 0) {
+				path = argv[2];
+			} else {
+				usage();
+			}
+			argc -= 2;
+			argv += 2;
+		}
+		if (argc != 1)
+			usage();
+		target_profile(&selected, interval, samples, path);
 		return (0);
 	}
 
@@ -113,27 +329,181 @@ main(int argc, char *argv[])
 		return (0);
 	}
 
+	if (strcmp(argv[0], "twsi") == 0) {
+		if (argc < 2)
+			usage();
+		memset(&to, 0, sizeof to);
+		if (strcmp(argv[1], "read") == 0)
+			to.to_write = false;
+		else if (strcmp(argv[1], "write") == 0)
+			to.to_write = true;
+		else
+			usage();
+		argc--;
+		argv++;
+
+		to.to_iawidth = 8;
+		to.to_hz = TWSI_HZ_SLOW;
+		while (argc >= 3 && argv[1][0] == '-') {
+			if (strcmp(argv[1], "-a") == 0) {
+				to.to_iawidth = parse_number(argv[2], "internal address width");
+				if (to.to_iawidth != 0 && to.to_iawidth != 8 &&
+				    to.to_iawidth != 16)
+					errx(1, "invalid internal address width: %s", argv[2]);
+			} else if (strcmp(argv[1], "-c") == 0) {
+				value = parse_number(argv[2], "clock");
+				if (value < TWSI_HZ_MIN / 1000 || value > TWSI_HZ_FAST / 1000)
+					errx(1, "invalid clock: %s", argv[2]);
+				to.to_hz = value * 1000;
+			} else {
+				usage();
+			}
+			argc -= 2;
+			argv += 2;
+		}
+		if (argc != 5)
+			usage();
+
+		to.to_bus = parse_number(argv[1], "TWSI bus");
+		if (to.to_bus >= TWSI_BUSES)
+			errx(1, "invalid TWSI bus: %s", argv[1]);
+		value = parse_number(argv[2], "device address");
+		if (value > 0x7f)
+			errx(1, "invalid device address: %s", argv[2]);
+		to.to_dev = value;
+		value = parse_number(argv[3], "internal address");
+		if (value >= 1u << to.to_iawidth)
+			errx(1, "invalid internal address: %s", argv[3]);
+		to.to_ia = value;
+
+		if (to.to_write) {
+			to.to_len = parse_bytes(to.to_data, sizeof to.to_data, argv[4], "data");
+		} else {
+			value = parse_number(argv[4], "length");
+			if (value == 0 || value > TWSI_IO_MAX)
+				errx(1, "invalid length: %s", argv[4]);
+			to.to_len = value;
+		}
+		if (to.to_len == 0)
+			usage();
+		target_twsi(&selected, &to);
+		return (0);
+	}
+
 	fprintf(stderr, "unknown command: %s\n", argv[0]);
 	usage();
 }
 
+/*
+ * Parse bytes given in hexadecimal, two digits per byte, into a
+ * buffer of the given size, returning how many there were.
+ */
+static size_t
+parse_bytes(uint8_t *buf, size_t size, const char *s, const char *what)
+{
+	const char *p;
+	char hex[3];
+	size_t len;
+
+	len = 0;
+	for (p = s; *p != '\0'; p += 2) {
+		if (!isxdigit((unsigned char)p[0]) ||
+		    !isxdigit((unsigned char)p[1]))
+			errx(1, "invalid %s: %s", what, s);
+		if (len == size)
+			errx(1, "%s longer than %zu bytes: %s", what, size, s);
+		hex[0] = p[0];
+		hex[1] = p[1];
+		hex[2] = '\0';
+		buf[len++] = strtoul(hex, NULL, 16);
+	}
+	return (len);
+}
+
+/*
+ * Parse a mailbox message of the form opcode[:payload], where the
+ * payload is given in hexadecimal, two digits per byte.
+ */
+static void
+parse_message(struct mbox_msg *mm, uint32_t tag, const char *s)
+{
+	const char *colon;
+	uint64_t op;
+	char *opstr;
+
+	colon = strchr(s, ':');
+	if (colon == NULL) {
+		op = parse_number(s, "opcode");
+	} else {
+		opstr = strndup(s, colon - s);
+		if (opstr == NULL)
+			err(1, "strndup");
+		op = parse_number(opstr, "opcode");
+		free(opstr);
+	}
+	if (op > UINT16_MAX)
+		errx(1, "invalid opcode: %s", s);
+
+	mm->mm_tag = tag;
+	mm->mm_op = op;
+	mm->mm_len = 0;
+	if (colon == NULL)
+		return;
+
+	mm->mm_len = parse_bytes(mm->mm_data, MBOX_DATA_MAX, colon + 1, "payload");
+}
+
+static uint64_t
+parse_number(const char *s, const char *what)
+{
+	unsigned long long n;
+	char *end;
+
+	errno = 0;
+	n = strtoull(s, &end, 0);
+	if (*s == '\0' || *end != '\0' || errno != 0)
+		errx(1, "invalid %s: %s", what, s);
+	return (n);
+}
+
 static void
 usage(void)
 {
 	fprintf(stderr,
 "usage: bsdoct\n"
-"       bsdoct -a command\n"
-"       bsdoct -s target-number [-s target-number ...] command\n"
+"       bsdoct [-w] [-D address] [-T text|json] -a command\n"
+"       bsdoct [-w] [-D address] [-T text|json] -s target-list [-s target-list ...] command\n"
 "\n"
+"       -w maps BAR1 write-combining, where the host supports it\n"
+"       -D enables DMA for large memory transfers, using 4KB of target\n"
+"          memory at the given address, which must be otherwise unused;\n"
+"          every enabled DPI engine is also left servicing DMA queue 7\n"
+"       -T reports where startup time went, per target and by phase,\n"
+"          on standard error\n"
 "       if only one target is available, it will be selected by default\n"
+"       a target-list is a comma-separated list of target numbers and\n"
+"       ranges, e.g. 0,2,4-7 or 8- for target 8 onwards\n"
 "\n"
 "       no command: show selected targets\n"
 "       no command and no selectors: enumerate available targets\n"
 "\n"
 "       commands:\n"
+"           apply [-n] state-file\n"
 "           boot [bootloader-path]\n"
-"           console\n"
+"           call opcode[:hex-payload] ...\n"
+"           console [-o file-prefix] [console-number]\n"
+"           cores reset|release|debug core-mask\n"
+"           cores restart [-g cores-per-group] [-d delay-ms] core-mask\n"
+"           csr read csr-name[index] ...\n"
+"           csr write csr-name[index] value\n"
+"           csr -f script\n"
+"           fuses\n"
+"           mem read address length [file]\n"
+"           mem write address file\n"
+"           profile [-i interval-ms] [-n samples] [-o file]\n"
 "           reset\n"
-"           show\n");
+"           show [-b]\n"
+"           twsi read [-a 0|8|16] [-c clock-khz] bus device internal-address length\n"
+"           twsi write [-a 0|8|16] [-c clock-khz] bus device internal-address hex-data\n");
 	exit(1);
 }
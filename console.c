@@ -0,0 +1,534 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <assert.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <cvmx.h>
+
+#include "console.h"
+#include "host.h"
+#include "target.h"
+#include "timing.h"
+
+/*
+ * The bootloader leaves the address of its bootmem descriptor here
+ * for PCI hosts, and software on the target allocates the console
+ * rings in a bootmem named block.
+ */
+#define	CONSOLE_BOOTMEM_DESC_ADDR	(0x6c100)
+#define	CONSOLE_BOOTMEM_VERSION		(3)
+#define	CONSOLE_BLOCK_NAME		"__pci_console"
+
+/*
+ * Limits on what we will believe of a bootmem descriptor, which may
+ * be uninitialized memory if no bootloader has run.
+ */
+#define	CONSOLE_BOOTMEM_BLOCKS_MAX	(1024)
+#define	CONSOLE_BOOTMEM_NAME_MAX	(256)
+
+/*
+ * Console output is copied in chunks of up to CONSOLE_CHUNK bytes.
+ * When no console has output, we sleep for a period which doubles
+ * from CONSOLE_IDLE_MIN to CONSOLE_IDLE_MAX, and while output is
+ * flowing we do not sleep at all.  A target whose console has not
+ * yet been created is checked for it every CONSOLE_PROBE_INTERVAL.
+ */
+#define	CONSOLE_CHUNK			(65536)
+#define	CONSOLE_IDLE_MIN		(1)		/* Milliseconds.  */
+#define	CONSOLE_IDLE_MAX		(64)		/* Milliseconds.  */
+#define	CONSOLE_PROBE_INTERVAL		(1000)		/* Milliseconds.  */
+
+/*
+ * Layouts of the SDK's bootmem descriptor, bootmem named block
+ * descriptor, octeon_pci_console_desc_t and octeon_pci_console_t,
+ * which are big-endian in target memory.  The SDK headers assume
+ * they are being built for the target.
+ */
+struct console_bootmem_desc {
+	uint32_t cbd_lock;
+	uint32_t cbd_flags;
+	uint64_t cbd_head_addr;
+	uint32_t cbd_major_version;
+	uint32_t cbd_minor_version;
+	uint64_t cbd_app_data_addr;
+	uint64_t cbd_app_data_size;
+	uint32_t cbd_named_block_num_blocks;
+	uint32_t cbd_named_block_name_len;
+	uint64_t cbd_named_block_array_addr;
+};
+
+struct console_named_block {
+	uint64_t cnb_base_addr;
+	uint64_t cnb_size;
+	char cnb_name[];		/* cbd_named_block_name_len bytes.  */
+};
+
+struct console_desc {
+	uint32_t cd_major_version;
+	uint32_t cd_minor_version;
+	uint32_t cd_lock;
+	uint32_t cd_flags;
+	uint32_t cd_num_consoles;
+	uint32_t cd_pad;
+	uint64_t cd_console_addr[];
+};
+
+struct console_ring {
+	uint64_t cr_input_base_addr;
+	uint32_t cr_input_read_index;
+	uint32_t cr_input_write_index;
+	uint64_t cr_output_base_addr;
+	uint32_t cr_output_read_index;
+	uint32_t cr_output_write_index;
+	uint32_t cr_lock;
+	uint32_t cr_buf_size;
+};
+
+/*
+ * Our view of one target's console.  We are the only writer of
+ * the output read index and the input write index, so we keep our
+ * own copies of those rather than reading them back.
+ */
+struct console_state {
+	struct target *cs_target;
+	int cs_fd;
+
+	bool cs_attached;
+	uint64_t cs_probe_time;
+
+	uint64_t cs_addr;
+	uint32_t cs_buf_size;
+	uint64_t cs_input_base;
+	uint64_t cs_output_base;
+	uint32_t cs_output_read;
+	uint32_t cs_input_write;
+};
+
+static volatile sig_atomic_t console_done;
+static struct termios console_termios;
+static bool console_termios_saved;
+
+static bool console_attach(struct console_state *, unsigned);
+static bool console_find(struct target *, uint64_t *);
+static bool console_output(struct console_state *, uint8_t *);
+static bool console_input(struct console_state *, uint8_t *, bool *);
+static uint32_t console_read4(struct target *, uint64_t);
+static void console_write4(struct target *, uint64_t, uint32_t);
+static void console_write_all(int, const uint8_t *, size_t);
+static void console_signal(int);
+static void console_tty_raw(void);
+static void console_tty_restore(void);
+
+void
+target_console_run(struct target **targets, unsigned ntargets, unsigned console, const char *prefix)
+{
+	struct console_state *states, *cs;
+	bool active, forward, inputfull, waitinput;
+	struct pollfd pfd;
+	unsigned i, idle;
+	uint64_t now;
+	uint8_t *buf;
+	char *path;
+
+	assert(ntargets != 0);
+	assert(prefix != NULL || ntargets == 1);
+
+	states = calloc(ntargets, sizeof *states);
+	if (states == NULL)
+		err(1, "calloc");
+	buf = malloc(CONSOLE_CHUNK);
+	if (buf == NULL)
+		err(1, "malloc");
+
+	for (i = 0; i < ntargets; i++) {
+		cs = &states[i];
+		cs->cs_target = targets[i];
+
+		if (!cs->cs_target->t_pci_bar[1].tb_enabled)
+			errx(1, "target%u: BAR1 not available for console.", cs->cs_target->t_unit);
+
+		if (prefix == NULL) {
+			cs->cs_fd = STDOUT_FILENO;
+		} else {
+			if (asprintf(&path, "%s%u", prefix, cs->cs_target->t_unit) == -1)
+				err(1, "asprintf");
+			cs->cs_fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+			if (cs->cs_fd == -1)
+				err(1, "open %s", path);
+			free(path);
+		}
+	}
+
+	signal(SIGINT, console_signal);
+	signal(SIGTERM, console_signal);
+
+	/*
+	 * Standard input goes to the console only when it is
+	 * interactive with a single target.
+	 */
+	forward = prefix == NULL;
+	if (forward) {
+		if (fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK) == -1)
+			err(1, "fcntl");
+		console_tty_raw();
+	}
+
+	idle = 0;
+	inputfull = false;
+	while (!console_done) {
+		active = false;
+		now = timing_now() / 1000;
+		for (i = 0; i < ntargets; i++) {
+			cs = &states[i];
+			if (!cs->cs_attached) {
+				if (cs->cs_probe_time != 0 &&
+				    now - cs->cs_probe_time < CONSOLE_PROBE_INTERVAL)
+					continue;
+				if (!console_attach(cs, console)) {
+					if (cs->cs_probe_time == 0)
+						fprintf(stderr, "target%u: waiting for console\n", cs->cs_target->t_unit);
+					cs->cs_probe_time = now;
+					continue;
+				}
+			}
+			if (console_output(cs, buf))
+				active = true;
+		}
+
+		/*
+		 * Sleep only when no console had output, for longer
+		 * the longer they stay idle, but wake as soon as
+		 * there is input to forward.
+		 */
+		if (active) {
+			idle = 0;
+		} else if (idle == 0) {
+			idle = CONSOLE_IDLE_MIN;
+		} else if (idle < CONSOLE_IDLE_MAX) {
+			idle *= 2;
+		}
+
+		/*
+		 * If the console had no room for input last time,
+		 * sleep without waiting on standard input, since it
+		 * would otherwise wake us immediately.
+		 */
+		pfd.fd = STDIN_FILENO;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		waitinput = forward && states[0].cs_attached && !inputfull;
+		inputfull = false;
+		if (poll(&pfd, waitinput ? 1 : 0, idle) == -1) {
+			if (errno == EINTR)
+				continue;
+			err(1, "poll");
+		}
+		if (waitinput && (pfd.revents & (POLLIN | POLLHUP)) != 0) {
+			if (console_input(&states[0], buf, &forward))
+				idle = 0;
+			else
+				inputfull = true;
+		}
+	}
+
+	console_tty_restore();
+
+	for (i = 0; i < ntargets; i++) {
+		if (states[i].cs_fd != STDOUT_FILENO)
+			close(states[i].cs_fd);
+	}
+	free(buf);
+	free(states);
+}
+
+/*
+ * Find the given console on a target, returning false if it does
+ * not have one yet.
+ */
+static bool
+console_attach(struct console_state *cs, unsigned console)
+{
+	struct console_ring cr;
+	struct console_desc cd;
+	struct target *t;
+	uint64_t addr;
+
+	t = cs->cs_target;
+
+	if (!console_find(t, &addr))
+		return (false);
+
+	target_mem_read(t, addr, &cd, sizeof cd);
+	if (console >= be32toh(cd.cd_num_consoles))
+		errx(1, "target%u: console %u not present; %u consoles.", t->t_unit, console, be32toh(cd.cd_num_consoles));
+	addr = target_mem_read8(t, addr + offsetof(struct console_desc, cd_console_addr[console]));
+	if (addr % 8 != 0)
+		errx(1, "target%u: console %u is misaligned at %#jx.", t->t_unit, console, (uintmax_t)addr);
+
+	target_mem_read(t, addr, &cr, sizeof cr);
+	cs->cs_addr = addr;
+	cs->cs_buf_size = be32toh(cr.cr_buf_size);
+	cs->cs_input_base = be64toh(cr.cr_input_base_addr);
+	cs->cs_output_base = be64toh(cr.cr_output_base_addr);
+	cs->cs_output_read = be32toh(cr.cr_output_read_index);
+	cs->cs_input_write = be32toh(cr.cr_input_write_index);
+	if (cs->cs_buf_size == 0 || cs->cs_output_read >= cs->cs_buf_size ||
+	    cs->cs_input_write >= cs->cs_buf_size)
+		errx(1, "target%u: console %u is corrupt.", t->t_unit, console);
+
+	cs->cs_attached = true;
+	return (true);
+}
+
+/*
+ * Look up the console descriptor's named block through the bootmem
+ * descriptor, reading the named block array in one transfer.
+ */
+static bool
+console_find(struct target *t, uint64_t *addrp)
+{
+	struct console_bootmem_desc cbd;
+	size_t entry, name_len;
+	uint64_t addr, size;
+	unsigned i, nblocks;
+	uint8_t *array, *p;
+
+	target_mem_read(t, CONSOLE_BOOTMEM_DESC_ADDR, &addr, sizeof addr);
+	addr = be64toh(addr);
+	if (addr == 0)
+		return (false);
+
+	target_mem_read(t, addr, &cbd, sizeof cbd);
+	if (be32toh(cbd.cbd_major_version) != CONSOLE_BOOTMEM_VERSION)
+		return (false);
+
+	nblocks = be32toh(cbd.cbd_named_block_num_blocks);
+	name_len = be32toh(cbd.cbd_named_block_name_len);
+	if (nblocks == 0 || nblocks > CONSOLE_BOOTMEM_BLOCKS_MAX ||
+	    name_len < sizeof CONSOLE_BLOCK_NAME || name_len > CONSOLE_BOOTMEM_NAME_MAX)
+		return (false);
+
+	entry = offsetof(struct console_named_block, cnb_name) + name_len;
+	array = malloc(nblocks * entry);
+	if (array == NULL)
+		err(1, "malloc");
+	target_mem_read(t, be64toh(cbd.cbd_named_block_array_addr), array, nblocks * entry);
+
+	/*
+	 * Entries are not necessarily aligned, so copy fields out.
+	 */
+	for (i = 0; i < nblocks; i++) {
+		p = array + i * entry;
+		memcpy(&size, p + offsetof(struct console_named_block, cnb_size), sizeof size);
+		if (size == 0)
+			continue;
+		if (strncmp((const char *)p + offsetof(struct console_named_block, cnb_name), CONSOLE_BLOCK_NAME, name_len) != 0)
+			continue;
+		memcpy(&addr, p + offsetof(struct console_named_block, cnb_base_addr), sizeof addr);
+		*addrp = be64toh(addr);
+		free(array);
+		return (true);
+	}
+
+	free(array);
+	return (false);
+}
+
+/*
+ * Copy any pending output from a console, returning true if there
+ * was some.
+ */
+static bool
+console_output(struct console_state *cs, uint8_t *buf)
+{
+	uint32_t n, ridx, widx;
+	struct target *t;
+
+	t = cs->cs_target;
+
+	widx = console_read4(t, cs->cs_addr + offsetof(struct console_ring, cr_output_write_index));
+	if (widx >= cs->cs_buf_size)
+		errx(1, "target%u: console output index out of range.", t->t_unit);
+
+	ridx = cs->cs_output_read;
+	if (ridx == widx)
+		return (false);
+
+	while (ridx != widx) {
+		n = (widx > ridx ? widx : cs->cs_buf_size) - ridx;
+		if (n > CONSOLE_CHUNK)
+			n = CONSOLE_CHUNK;
+		target_mem_read(t, cs->cs_output_base + ridx, buf, n);
+		console_write_all(cs->cs_fd, buf, n);
+		ridx = (ridx + n) % cs->cs_buf_size;
+	}
+
+	cs->cs_output_read = ridx;
+	console_write4(t, cs->cs_addr + offsetof(struct console_ring, cr_output_read_index), ridx);
+
+	return (true);
+}
+
+/*
+ * Send what input is available to a console, as much as it has room
+ * for; the rest is left unread until the next call.  Returns false
+ * if the console had no room.  At end of file, clears *forwardp.
+ */
+static bool
+console_input(struct console_state *cs, uint8_t *buf, bool *forwardp)
+{
+	uint32_t n, ridx, space, widx;
+	struct target *t;
+	ssize_t len;
+
+	t = cs->cs_target;
+
+	ridx = console_read4(t, cs->cs_addr + offsetof(struct console_ring, cr_input_read_index));
+	widx = cs->cs_input_write;
+
+	/*
+	 * One byte is always left free, so that a full ring can be
+	 * told from an empty one.
+	 */
+	space = (ridx + cs->cs_buf_size - widx - 1) % cs->cs_buf_size;
+	if (space == 0)
+		return (false);
+	if (space > CONSOLE_CHUNK)
+		space = CONSOLE_CHUNK;
+
+	len = read(STDIN_FILENO, buf, space);
+	if (len == -1) {
+		if (errno == EAGAIN || errno == EINTR)
+			return (true);
+		err(1, "read");
+	}
+	if (len == 0) {
+		*forwardp = false;
+		return (true);
+	}
+
+	space = len;
+	while (space != 0) {
+		n = cs->cs_buf_size - widx;
+		if (n > space)
+			n = space;
+		target_mem_write(t, cs->cs_input_base + widx, buf, n);
+		buf += n;
+		space -= n;
+		widx = (widx + n) % cs->cs_buf_size;
+	}
+
+	cs->cs_input_write = widx;
+	console_write4(t, cs->cs_addr + offsetof(struct console_ring, cr_input_write_index), widx);
+
+	return (true);
+}
+
+/*
+ * Ring indexes are shared with the target, so each is read or
+ * written in a single access.
+ */
+static uint32_t
+console_read4(struct target *t, uint64_t addr)
+{
+	return (target_mem_read4(t, addr));
+}
+
+static void
+console_write4(struct target *t, uint64_t addr, uint32_t v)
+{
+	target_mem_write4(t, addr, v);
+}
+
+static void
+console_write_all(int fd, const uint8_t *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len != 0) {
+		n = write(fd, buf, len);
+		if (n == -1) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			err(1, "write");
+		}
+		buf += n;
+		len -= n;
+	}
+}
+
+static void
+console_signal(int sig)
+{
+	(void)sig;
+	console_done = 1;
+}
+
+/*
+ * Pass keystrokes through to the target as they are typed, leaving
+ * signal generation alone so that ^C still stops us.
+ */
+static void
+console_tty_raw(void)
+{
+	struct termios tio;
+
+	if (!isatty(STDIN_FILENO))
+		return;
+	if (tcgetattr(STDIN_FILENO, &console_termios) == -1)
+		err(1, "tcgetattr");
+	console_termios_saved = true;
+
+	tio = console_termios;
+	tio.c_lflag &= ~(ICANON | ECHO);
+	tio.c_cc[VMIN] = 1;
+	tio.c_cc[VTIME] = 0;
+	if (tcsetattr(STDIN_FILENO, TCSANOW, &tio) == -1)
+		err(1, "tcsetattr");
+	atexit(console_tty_restore);
+}
+
+static void
+console_tty_restore(void)
+{
+	if (!console_termios_saved)
+		return;
+	(void)tcsetattr(STDIN_FILENO, TCSANOW, &console_termios);
+	console_termios_saved = false;
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <cvmx.h>
+
+#include "cores.h"
+#include "host.h"
+#include "lock.h"
+#include "target.h"
+
+static void target_cores_reset(struct target *, uint64_t, bool);
+static void target_cores_restart(struct target *, const struct target_cores_req *);
+
+void
+target_cores_run(struct target *t, const struct target_cores_req *tcr)
+{
+	if (tcr->tcr_mask == 0 || (tcr->tcr_mask & ~t->t_core_mask) != 0)
+		errx(1, "target%u: core mask 0x%016jx is not within core mask 0x%016jx.", t->t_unit, (uintmax_t)tcr->tcr_mask, (uintmax_t)t->t_core_mask);
+
+	switch (tcr->tcr_op) {
+	case TARGET_CORES_RESET:
+		target_cores_reset(t, tcr->tcr_mask, true);
+		break;
+	case TARGET_CORES_RELEASE:
+		target_cores_reset(t, tcr->tcr_mask, false);
+		break;
+	case TARGET_CORES_DEBUG:
+		/*
+		 * A core leaves debug mode only by returning from its
+		 * debug handler, or through reset, so there is nothing
+		 * corresponding to release here.
+		 */
+		target_write_csr(t, t->t_csrs.tc_ciu_dint, tcr->tcr_mask);
+		break;
+	case TARGET_CORES_RESTART:
+		target_cores_restart(t, tcr);
+		break;
+	}
+}
+
+/*
+ * Put cores into or take them out of reset, leaving the others as
+ * they are.  The lock keeps another process's update to CIU_PP_RST
+ * from falling between our read and write, and the register is read
+ * back so that the change has taken effect when we return.
+ */
+static void
+target_cores_reset(struct target *t, uint64_t mask, bool reset)
+{
+	uint64_t rst;
+
+	target_lock(t, TARGET_LOCK_CORES);
+	rst = target_read_csr(t, t->t_csrs.tc_ciu_pp_rst);
+	if (reset)
+		rst |= mask;
+	else
+		rst &= ~mask;
+	target_write_csr(t, t->t_csrs.tc_ciu_pp_rst, rst);
+	(void)target_read_csr(t, t->t_csrs.tc_ciu_pp_rst);
+	target_unlock(t, TARGET_LOCK_CORES);
+}
+
+/*
+ * A core released from reset starts at the reset vector on the boot
+ * bus, as at power on, so what it goes on to run is up to whatever
+ * answers there.  Unless a boot stub has been installed in the boot
+ * bus local memory, which is what waits for a released core to be
+ * given somewhere to go, the core runs the flash bootloader from the
+ * beginning, or nothing at all.
+ */
+bool
+target_cores_stub_enabled(struct target *t)
+{
+	cvmx_mio_boot_loc_cfgx_t mblc;
+
+	mblc.u64 = target_read_csr(t, t->t_csrs.tc_mio_boot_loc_cfg);
+	return (mblc.s.en);
+}
+
+static void
+target_cores_restart(struct target *t, const struct target_cores_req *tcr)
+{
+	uint64_t group, remaining;
+	struct timespec ts;
+	unsigned count, i;
+
+	if (!target_cores_stub_enabled(t))
+		errx(1, "target%u: no boot stub enabled in MIO_BOOT_LOC_CFG0, so restarted cores would not return to running software.", t->t_unit);
+
+	remaining = tcr->tcr_mask;
+	while (remaining != 0) {
+		group = 0;
+		count = 0;
+		for (i = 0; i < 64; i++) {
+			if ((remaining & (1ull << i)) == 0)
+				continue;
+			group |= 1ull << i;
+			if (++count == tcr->tcr_group)
+				break;
+		}
+		remaining &= ~group;
+
+		target_cores_reset(t, group, true);
+		target_cores_reset(t, group, false);
+		printf("target%u: restarted cores 0x%016jx\n", t->t_unit, (uintmax_t)group);
+		fflush(stdout);
+
+		if (remaining != 0 && tcr->tcr_delay != 0) {
+			ts.tv_sec = tcr->tcr_delay / 1000;
+			ts.tv_nsec = (long)(tcr->tcr_delay % 1000) * 1000000;
+			nanosleep(&ts, NULL);
+		}
+	}
+}
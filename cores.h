@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#ifndef	CORES_H
+#define	CORES_H
+
+struct target;
+
+/*
+ * Operations on a subset of a target's cores, leaving the others,
+ * and the rest of the chip, running.
+ *
+ * A released core starts at the reset vector, as at power on, so
+ * only software which expects that, such as a boot stub in the boot
+ * bus local memory, will see it again.  TARGET_CORES_RESTART puts the
+ * cores through reset a group at a time, waiting between groups, so
+ * that a set of worker cores can be restarted while the remainder
+ * carry their load; it is refused unless a boot stub is enabled.
+ *
+ * target_cores_stub_enabled reports whether one is, for apply, which
+ * releases cores after loading an image.
+ */
+enum target_cores_op {
+	TARGET_CORES_RESET,	/* Hold in reset.  */
+	TARGET_CORES_RELEASE,	/* Release from reset.  */
+	TARGET_CORES_DEBUG,	/* Send a debug interrupt.  */
+	TARGET_CORES_RESTART,	/* Reset and release, by group.  */
+};
+
+struct target_cores_req {
+	enum target_cores_op tcr_op;
+	uint64_t tcr_mask;
+	unsigned tcr_group;	/* Cores per group, or 0 for all at once.  */
+	unsigned tcr_delay;	/* Milliseconds between groups.  */
+};
+
+void target_cores_run(struct target *, const struct target_cores_req *);
+bool target_cores_stub_enabled(struct target *);
+
+#endif /* !CORES_H */
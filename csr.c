@@ -0,0 +1,351 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <ctype.h>
+#include <err.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cvmx.h>
+
+#include "csr.h"
+#include "cvmx_compat.h"
+#include "host.h"
+#include "target.h"
+
+#ifndef	howmany
+#define	howmany(a)	(sizeof (a) / sizeof *(a))
+#endif
+
+#define	CSR_NAME_MAX	(128)
+
+/*
+ * Reads between writes are issued in batches of up to CSR_BATCH
+ * through target_read_csr_batch.
+ */
+#define	CSR_BATCH	(256)
+
+static uint64_t csr_hash(const char *, uint64_t, uint64_t);
+static void csr_parse_at(struct csr_op *, const char *, const char *, const char *, unsigned long);
+static bool csr_is_sli(const struct csr_desc *);
+static uint64_t csr_addr(const struct target *, const struct csr_op *);
+static void csr_print(const struct target *, const struct csr_op *, uint64_t);
+
+/*
+ * Look up a CSR by name, with or without the SDK's CVMX_ prefix, in
+ * the perfect hash table generated by csrgen.awk, which describes
+ * the hash functions used here.
+ */
+const struct csr_desc *
+csr_lookup(const char *name)
+{
+	char key[CSR_NAME_MAX];
+	const struct csr_desc *cd;
+	uint64_t slot, step;
+	unsigned b;
+	size_t i;
+
+	if (strncasecmp(name, "CVMX_", 5) == 0)
+		name += 5;
+	for (i = 0; name[i] != '\0'; i++) {
+		if (i == sizeof key - 1)
+			return (NULL);
+		key[i] = toupper((unsigned char)name[i]);
+	}
+	key[i] = '\0';
+
+	b = csr_hash(key, 5381, 33) % csr_buckets;
+	step = csr_hash(key, 11, 37) % (csr_table_size - 1) + 1;
+	slot = (csr_hash(key, 7, 31) + csr_displace[b] * step) % csr_table_size;
+
+	cd = &csr_table[slot];
+	if (cd->cd_name == NULL || strcmp(cd->cd_name, key) != 0)
+		return (NULL);
+	return (cd);
+}
+
+/*
+ * Parse a CSR given as NAME, NAME[i] or NAME[i,j], and the value to
+ * be written to it, or NULL for a read.
+ */
+void
+csr_parse(struct csr_op *co, const char *spec, const char *value)
+{
+	csr_parse_at(co, spec, value, NULL, 0);
+}
+
+/*
+ * Parse a script of CSR operations, one per line, each of which is
+ * either "read CSR" or "write CSR value".  Blank lines and anything
+ * following a # are ignored.  A path of - reads standard input.
+ */
+void
+csr_script(const char *path, struct csr_op **opsp, unsigned *nopsp)
+{
+	unsigned nops, ntoks, size;
+	char *line, *p, *toks[3];
+	unsigned long lineno;
+	struct csr_op *ops;
+	size_t linesize;
+	FILE *fp;
+
+	if (strcmp(path, "-") == 0) {
+		fp = stdin;
+	} else {
+		fp = fopen(path, "r");
+		if (fp == NULL)
+			err(1, "fopen %s", path);
+	}
+
+	ops = NULL;
+	nops = 0;
+	size = 0;
+	line = NULL;
+	linesize = 0;
+	lineno = 0;
+	while (getline(&line, &linesize, fp) != -1) {
+		lineno++;
+		p = strchr(line, '#');
+		if (p != NULL)
+			*p = '\0';
+
+		ntoks = 0;
+		for (p = strtok(line, " \t\n"); p != NULL; p = strtok(NULL, " \t\n")) {
+			if (ntoks == howmany(toks))
+				errx(1, "%s:%lu: too many words.", path, lineno);
+			toks[ntoks++] = p;
+		}
+		if (ntoks == 0)
+			continue;
+
+		if (nops == size) {
+			size = size == 0 ? 64 : size * 2;
+			ops = reallocarray(ops, size, sizeof *ops);
+			if (ops == NULL)
+				err(1, "reallocarray");
+		}
+
+		if (ntoks == 2 && strcmp(toks[0], "read") == 0)
+			csr_parse_at(&ops[nops++], toks[1], NULL, path, lineno);
+		else if (ntoks == 3 && strcmp(toks[0], "write") == 0)
+			csr_parse_at(&ops[nops++], toks[1], toks[2], path, lineno);
+		else
+			errx(1, "%s:%lu: expected \"read CSR\" or \"write CSR value\".", path, lineno);
+	}
+	if (ferror(fp))
+		err(1, "read %s", path);
+	free(line);
+	if (fp != stdin)
+		fclose(fp);
+
+	*opsp = ops;
+	*nopsp = nops;
+}
+
+/*
+ * Run a list of CSR operations on a target, which must be selected
+ * so that addresses are evaluated for its model.  Runs of reads go
+ * through the window in batches, and each read is printed with its
+ * fields decoded.
+ */
+void
+target_csr_run(struct target *t, const struct csr_op *ops, unsigned nops)
+{
+	uint64_t addrs[CSR_BATCH], vals[CSR_BATCH];
+	const struct csr_op *co;
+	unsigned count, i, j;
+	uint64_t addr;
+
+	/*
+	 * Evaluate every address before accessing any, so that an
+	 * index the SDK rejects stops the whole run.
+	 */
+	for (i = 0; i < nops; i++)
+		(void)csr_addr(t, &ops[i]);
+
+	for (i = 0; i < nops; i = j) {
+		co = &ops[i];
+		addr = csr_addr(t, co);
+
+		if (co->co_write) {
+			if (csr_is_sli(co->co_csr))
+				target_write_sli(t, addr, co->co_value);
+			else
+				target_write_csr(t, addr, co->co_value);
+			j = i + 1;
+			continue;
+		}
+
+		if (csr_is_sli(co->co_csr)) {
+			csr_print(t, co, target_read_sli(t, addr));
+			j = i + 1;
+			continue;
+		}
+
+		count = 0;
+		for (j = i; j < nops && count < CSR_BATCH; j++) {
+			co = &ops[j];
+			if (co->co_write || csr_is_sli(co->co_csr))
+				break;
+			addrs[count++] = csr_addr(t, co);
+		}
+
+		target_read_csr_batch(t, addrs, vals, count);
+		for (count = 0; i + count < j; count++)
+			csr_print(t, &ops[i + count], vals[count]);
+	}
+}
+
+/*
+ * Evaluate a CSR's address for the selected target.  The SDK warns,
+ * rather than failing, when an index is out of range for the model,
+ * so treat any warning as fatal.
+ */
+static uint64_t
+csr_addr(const struct target *t, const struct csr_op *co)
+{
+	unsigned warnings;
+	uint64_t addr;
+
+	warnings = cvmx_warnings;
+	addr = co->co_csr->cd_addr(co->co_args[0], co->co_args[1]);
+	if (cvmx_warnings != warnings)
+		errx(1, "target%u: %s index out of range for this target.", t->t_unit, co->co_csr->cd_name);
+	return (addr);
+}
+
+/*
+ * The hash used by csrgen.awk, over names which are in upper case.
+ */
+static uint64_t
+csr_hash(const char *s, uint64_t h, uint64_t mult)
+{
+	while (*s != '\0')
+		h = (h * mult + (unsigned char)*s++) % 4294967291u;
+	return (h);
+}
+
+static void
+csr_parse_at(struct csr_op *co, const char *spec, const char *value, const char *path, unsigned long lineno)
+{
+	char name[CSR_NAME_MAX], where[CSR_NAME_MAX + 32];
+	const char *bracket, *p;
+	unsigned nargs;
+	char *end;
+
+	if (path == NULL)
+		where[0] = '\0';
+	else
+		snprintf(where, sizeof where, "%s:%lu: ", path, lineno);
+
+	bracket = strchr(spec, '[');
+	if (bracket == NULL)
+		bracket = spec + strlen(spec);
+	if ((size_t)(bracket - spec) >= sizeof name)
+		errx(1, "%sunknown CSR: %s", where, spec);
+	memcpy(name, spec, bracket - spec);
+	name[bracket - spec] = '\0';
+
+	co->co_csr = csr_lookup(name);
+	if (co->co_csr == NULL)
+		errx(1, "%sunknown CSR: %s", where, name);
+
+	co->co_args[0] = 0;
+	co->co_args[1] = 0;
+	nargs = 0;
+	if (*bracket == '[') {
+		p = bracket + 1;
+		for (;;) {
+			if (nargs == 2)
+				errx(1, "%stoo many indexes: %s", where, spec);
+			errno = 0;
+			co->co_args[nargs++] = strtoul(p, &end, 0);
+			if (end == p || errno != 0)
+				errx(1, "%sinvalid index: %s", where, spec);
+			p = end;
+			if (*p == ',') {
+				p++;
+				continue;
+			}
+			if (*p != ']' || p[1] != '\0')
+				errx(1, "%sinvalid index: %s", where, spec);
+			break;
+		}
+	}
+	if (nargs != co->co_csr->cd_nargs)
+		errx(1, "%s%s takes %u index%s.", where, co->co_csr->cd_name,
+		    co->co_csr->cd_nargs, co->co_csr->cd_nargs == 1 ? "" : "es");
+
+	co->co_write = value != NULL;
+	co->co_value = 0;
+	if (value != NULL) {
+		errno = 0;
+		co->co_value = strtoull(value, &end, 0);
+		if (*value == '\0' || *end != '\0' || errno != 0)
+			errx(1, "%sinvalid value: %s", where, value);
+	}
+}
+
+/*
+ * The SDK gives SLI registers as offsets in BAR0, where we access
+ * them directly, rather than as window addresses.
+ */
+static bool
+csr_is_sli(const struct csr_desc *cd)
+{
+	return (strncmp(cd->cd_name, "SLI_", 4) == 0);
+}
+
+static void
+csr_print(const struct target *t, const struct csr_op *co, uint64_t value)
+{
+	const struct csr_desc *cd;
+	const struct csr_field *cf;
+	char index[64];
+	uint64_t v;
+	unsigned i;
+
+	cd = co->co_csr;
+	if (cd->cd_nargs == 0)
+		index[0] = '\0';
+	else if (cd->cd_nargs == 1)
+		snprintf(index, sizeof index, "[%lu]", co->co_args[0]);
+	else
+		snprintf(index, sizeof index, "[%lu,%lu]", co->co_args[0], co->co_args[1]);
+
+	printf("target%u: %s%s = 0x%016jx\n", t->t_unit, cd->cd_name, index, (uintmax_t)value);
+	for (i = 0; i < cd->cd_nfields; i++) {
+		cf = &csr_fields[cd->cd_field + i];
+		v = value >> cf->cf_lsb;
+		if (cf->cf_width < 64)
+			v &= (1ull << cf->cf_width) - 1;
+		printf("target%u:     %s = %#jx\n", t->t_unit, cf->cf_name, (uintmax_t)v);
+	}
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	CSR_H
+#define	CSR_H
+
+struct target;
+
+/*
+ * CSRs by name, from a table generated from the SDK's definitions
+ * by csrgen.awk.  Each CSR has an address function, which evaluates
+ * the SDK's address macro with up to two indexes for the selected
+ * target, and the fields of its common layout.
+ */
+struct csr_field {
+	const char *cf_name;
+	uint8_t cf_lsb;
+	uint8_t cf_width;
+};
+
+typedef uint64_t csr_addr_t(unsigned long, unsigned long);
+
+struct csr_desc {
+	const char *cd_name;		/* NULL for an empty slot.  */
+	unsigned cd_nargs;
+	csr_addr_t *cd_addr;
+	unsigned cd_field;		/* First field in csr_fields.  */
+	unsigned cd_nfields;
+};
+
+/* Generated tables, in csr_table.c.  */
+extern const struct csr_field csr_fields[];
+extern const struct csr_desc csr_table[];
+extern const unsigned csr_table_size;
+extern const unsigned csr_displace[];
+extern const unsigned csr_buckets;
+
+/*
+ * A CSR read or write, as given on the command line or in a script.
+ */
+struct csr_op {
+	const struct csr_desc *co_csr;
+	unsigned long co_args[2];
+	bool co_write;
+	uint64_t co_value;
+};
+
+const struct csr_desc *csr_lookup(const char *);
+void csr_parse(struct csr_op *, const char *, const char *);
+void csr_script(const char *, struct csr_op **, unsigned *);
+void target_csr_run(struct target *, const struct csr_op *, unsigned);
+
+#endif /* !CSR_H */
@@ -0,0 +1,324 @@
+#
+# Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+#
+
+#
+# Generate csr_table.c from the SDK's cvmx-*-defs.h headers.
+#
+# A CSR is any CVMX_NAME address macro or function for which the
+# headers also define union cvmx_name.  For each, we emit a wrapper
+# which evaluates the SDK's address macro, so that model-dependent
+# addresses are resolved for whichever target is selected when the
+# CSR is used, and a list of the fields of the union's common
+# layout, taken from its big-endian bitfield declarations.
+#
+# Names are indexed with a hash-and-displace perfect hash.  A name's
+# bucket is chosen with csr_hash(name, 5381, 33), and its slot in
+# csr_table is then
+#
+#	(csr_hash(name, 7, 31) +
+#	    displacement * (csr_hash(name, 11, 37) % (size - 1) + 1)) % size
+#
+# where size is prime and the bucket's displacement is chosen here
+# so that no two names share a slot.  csr.c must hash the same way.
+#
+# With -v check=1, nothing is generated; instead every name is looked
+# up as csr.c would, and we fail unless each finds its own entry.
+# The Makefile's csrtest target runs this over synthetic definitions.
+#
+
+function csr_hash(s, h, mult,    i)
+{
+	for (i = 1; i <= length(s); i++)
+		h = (h * mult + ord[substr(s, i, 1)]) % 4294967291
+	return (h)
+}
+
+function is_prime(n,    i)
+{
+	if (n < 2)
+		return (0)
+	for (i = 2; i * i <= n; i++) {
+		if (n % i == 0)
+			return (0)
+	}
+	return (1)
+}
+
+#
+# Try to place every name in a table of the given size, returning
+# zero if some bucket cannot be placed.  The largest buckets go
+# first, while the table is emptiest, trying displacements until
+# every name in the bucket lands in a free slot distinct from the
+# others.
+#
+function place(n, size, nbuckets,    b, d, i, j, k, maxbucket, ok, s, slot, trial)
+{
+	split("", bsize)
+	split("", used)
+	split("", slotkey)
+
+	maxbucket = 0
+	for (i = 0; i < n; i++) {
+		b = csr_hash(keys[i], 5381, 33) % nbuckets
+		bucket[b, bsize[b]++] = i
+		if (bsize[b] > maxbucket)
+			maxbucket = bsize[b]
+		h2[i] = csr_hash(keys[i], 7, 31)
+		h3[i] = csr_hash(keys[i], 11, 37) % (size - 1) + 1
+	}
+
+	for (s = maxbucket; s > 0; s--) {
+		for (b = 0; b < nbuckets; b++) {
+			if (bsize[b] != s)
+				continue
+			for (d = 0; d < size; d++) {
+				ok = 1
+				split("", trial)
+				for (j = 0; j < s && ok; j++) {
+					k = bucket[b, j]
+					slot = (h2[k] + d * h3[k]) % size
+					if ((slot in used) || (slot in trial))
+						ok = 0
+					trial[slot] = k
+				}
+				if (ok)
+					break
+			}
+			if (!ok)
+				return (0)
+			disp[b] = d
+			for (slot in trial) {
+				used[slot] = 1
+				slotkey[slot] = trial[slot]
+			}
+		}
+	}
+	return (1)
+}
+
+function add_csr(name, nargs)
+{
+	if (name ~ /_FUNC$/)
+		return
+	if (!(name in csr_nargs))
+		csr_order[ncsrs++] = name
+	csr_nargs[name] = nargs
+}
+
+function count_args(s,    n)
+{
+	sub(/^[^(]*\(/, "", s)
+	sub(/\).*$/, "", s)
+	if (s ~ /^[ \t]*(void)?[ \t]*$/)
+		return (0)
+	n = gsub(/,/, ",", s)
+	return (n + 1)
+}
+
+BEGIN {
+	for (i = 1; i < 256; i++)
+		ord[sprintf("%c", i)] = i
+	ncsrs = 0
+	nheaders = 0
+	union = ""
+	infields = 0
+}
+
+FNR == 1 {
+	header = FILENAME
+	sub(/^.*\//, "", header)
+	headers[nheaders++] = header
+}
+
+/^#define[ \t]+CVMX_[A-Z0-9_]+[( \t]/ {
+	name = $2
+	sub(/\(.*$/, "", name)
+	sub(/^CVMX_/, "", name)
+	add_csr(name, index($2, "(") != 0 ? count_args($0) : 0)
+	next
+}
+
+/^static inline uint64_t CVMX_[A-Z0-9_]+\(/ {
+	name = $4
+	sub(/\(.*$/, "", name)
+	sub(/^CVMX_/, "", name)
+	add_csr(name, count_args($0))
+	next
+}
+
+/^union cvmx_[a-z0-9_]+/ {
+	union = $2
+	sub(/^cvmx_/, "", union)
+	sub(/[^a-z0-9_].*$/, "", union)
+	unions[union] = 1
+	nfields[union] = 0
+}
+
+union != "" && /uint32_t[ \t]+u32;/ {
+	narrow[union] = 1
+	next
+}
+
+union != "" && $0 ~ ("struct cvmx_" union "_s([ \t{]|$)") {
+	infields = 1
+	next
+}
+
+infields && /uint64_t[ \t]+[a-z0-9_]+[ \t]*:[ \t]*[0-9]+/ {
+	line = $0
+	sub(/^[ \t]*uint64_t[ \t]+/, "", line)
+	field = line
+	sub(/[ \t:].*$/, "", field)
+	width = line
+	sub(/^[^:]*:[ \t]*/, "", width)
+	sub(/[^0-9].*$/, "", width)
+	fields[union, nfields[union]++] = field " " width
+	next
+}
+
+infields && (/^#else/ || /^[ \t]*}/) {
+	infields = 0
+	union = ""
+	next
+}
+
+END {
+	# Keep CSRs with a 64-bit layout.
+	n = 0
+	for (i = 0; i < ncsrs; i++) {
+		name = csr_order[i]
+		u = tolower(name)
+		if (!(u in unions) || (u in narrow) || csr_nargs[name] > 2)
+			continue
+		keys[n++] = name
+	}
+	if (n == 0) {
+		print "csrgen.awk: no CSRs found" > "/dev/stderr"
+		exit 1
+	}
+
+	# Size the table for a load of about 0.8, with buckets
+	# holding four names on average.  If two names in a bucket
+	# probe the same sequence of slots, no displacement can
+	# separate them, so try again with a larger table.
+	size = int(n * 5 / 4) + 2
+	nbuckets = int((n + 3) / 4)
+	for (;;) {
+		while (!is_prime(size))
+			size++
+		if (place(n, size, nbuckets))
+			break
+		size++
+	}
+
+	if (check) {
+		bad = 0
+		for (i = 0; i < n; i++) {
+			b = csr_hash(keys[i], 5381, 33) % nbuckets
+			step = csr_hash(keys[i], 11, 37) % (size - 1) + 1
+			slot = (csr_hash(keys[i], 7, 31) + disp[b] * step) % size
+			if (!(slot in slotkey) || keys[slotkey[slot]] != keys[i]) {
+				print "csrgen.awk: " keys[i] " not found" > "/dev/stderr"
+				bad++
+			}
+		}
+		printf "csrgen.awk: %d names, %d slots, %d buckets, %d not found\n", n, size, nbuckets, bad
+		exit (bad != 0)
+	}
+
+	print "/* Generated by csrgen.awk from the SDK CSR definitions; do not edit.  */"
+	print ""
+	print "#include <sys/types.h>"
+	print "#include <stdbool.h>"
+	print "#include <stdint.h>"
+	print ""
+	print "#include <cvmx.h>"
+	for (i = 0; i < nheaders; i++)
+		print "#include <" headers[i] ">"
+	print ""
+	print "#include \"csr.h\""
+	print ""
+
+	for (i = 0; i < n; i++) {
+		name = keys[i]
+		print "static uint64_t"
+		print "csr_addr_" name "(unsigned long a, unsigned long b)"
+		print "{"
+		if (csr_nargs[name] == 0) {
+			print "\t(void)a;"
+			print "\t(void)b;"
+			print "\treturn (CVMX_" name ");"
+		} else if (csr_nargs[name] == 1) {
+			print "\t(void)b;"
+			print "\treturn (CVMX_" name "(a));"
+		} else {
+			print "\treturn (CVMX_" name "(a, b));"
+		}
+		print "}"
+		print ""
+	}
+
+	print "const struct csr_field csr_fields[] = {"
+	nf = 0
+	for (i = 0; i < n; i++) {
+		u = tolower(keys[i])
+		first[i] = nf
+		pos = 64
+		for (j = 0; j < nfields[u]; j++) {
+			split(fields[u, j], fw, " ")
+			pos -= fw[2]
+			if (fw[1] ~ /^reserved_/)
+				continue
+			printf "\t{ \"%s\", %d, %d },\n", fw[1], pos, fw[2]
+			nf++
+		}
+		count[i] = nf - first[i]
+	}
+	if (nf == 0)
+		print "\t{ NULL, 0, 0 },"
+	print "};"
+	print ""
+
+	print "const struct csr_desc csr_table[] = {"
+	for (slot = 0; slot < size; slot++) {
+		if (!(slot in slotkey)) {
+			print "\t{ NULL, 0, NULL, 0, 0 },"
+			continue
+		}
+		i = slotkey[slot]
+		printf "\t{ \"%s\", %d, csr_addr_%s, %d, %d },\n", keys[i], csr_nargs[keys[i]], keys[i], first[i], count[i]
+	}
+	print "};"
+	print ""
+	print "const unsigned csr_table_size = " size ";"
+	print ""
+
+	print "const unsigned csr_displace[] = {"
+	for (b = 0; b < nbuckets; b++)
+		printf "\t%d,\n", disp[b] + 0
+	print "};"
+	print ""
+	print "const unsigned csr_buckets = " nbuckets ";"
+}
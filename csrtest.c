@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Check csr_lookup against a table csrgen.awk has generated from
+ * synthetic definitions, as the Makefile's csrtest target does: every
+ * name must be found, with or without its CVMX_ prefix and in either
+ * case, at its own entry, and names not in the table must not be.
+ *
+ * csr.c is linked as it is built into bsdoct, so the accessors it
+ * calls are stubbed here; the test never reaches them.
+ */
+
+#include <sys/types.h>
+#include <ctype.h>
+#include <err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "csr.h"
+#include "host.h"
+#include "target.h"
+
+unsigned cvmx_warnings;
+
+static bool csrtest_find(const char *, const struct csr_desc *);
+
+int
+main(void)
+{
+	char name[128];
+	unsigned bad, i, n;
+	size_t j;
+
+	bad = 0;
+	n = 0;
+	for (i = 0; i < csr_table_size; i++) {
+		if (csr_table[i].cd_name == NULL)
+			continue;
+		n++;
+
+		if (!csrtest_find(csr_table[i].cd_name, &csr_table[i]))
+			bad++;
+
+		snprintf(name, sizeof name, "cvmx_%s", csr_table[i].cd_name);
+		for (j = 0; name[j] != '\0'; j++)
+			name[j] = tolower((unsigned char)name[j]);
+		if (!csrtest_find(name, &csr_table[i]))
+			bad++;
+
+		snprintf(name, sizeof name, "%s_NOT_A_CSR", csr_table[i].cd_name);
+		if (!csrtest_find(name, NULL))
+			bad++;
+	}
+
+	printf("csrtest: %u names, %u slots, %u failures\n", n, csr_table_size, bad);
+	return (bad != 0 || n == 0);
+}
+
+static bool
+csrtest_find(const char *name, const struct csr_desc *want)
+{
+	const struct csr_desc *cd;
+
+	cd = csr_lookup(name);
+	if (cd == want)
+		return (true);
+	fprintf(stderr, "csrtest: %s found at %s\n", name, cd == NULL ? "no entry" : cd->cd_name);
+	return (false);
+}
+
+uint64_t
+target_read_sli(const struct target *t, uint64_t addr)
+{
+	errx(1, "target%u: csrtest cannot read %#jx.", t->t_unit, (uintmax_t)addr);
+}
+
+void
+target_read_csr_batch(const struct target *t, const uint64_t *addrs, uint64_t *vals, unsigned n)
+{
+	(void)vals;
+	(void)n;
+	errx(1, "target%u: csrtest cannot read %#jx.", t->t_unit, (uintmax_t)addrs[0]);
+}
+
+void
+target_write_csr(const struct target *t, uint64_t addr, uint64_t data)
+{
+	(void)data;
+	errx(1, "target%u: csrtest cannot write %#jx.", t->t_unit, (uintmax_t)addr);
+}
+
+void
+target_write_sli(const struct target *t, uint64_t addr, uint64_t data)
+{
+	(void)data;
+	errx(1, "target%u: csrtest cannot write %#jx.", t->t_unit, (uintmax_t)addr);
+}
@@ -28,10 +28,14 @@
 #include <cvmx.h>
 
 #include "cvmx_compat.h"
+#include "fuse.h"
+#include "host.h"
 #include "target.h"
 
 static struct target *current_target;
 
+unsigned cvmx_warnings;
+
 void
 cvmx_select_target(struct target *t)
 {
@@ -57,6 +61,8 @@ cvmx_warn(const char *fmt, ...)
 	va_end(ap);
 
 	fflush(stderr);
+
+	cvmx_warnings++;
 }
 
 uint32_t
@@ -89,22 +95,8 @@ cvmx_pop(uint32_t w)
 uint8_t
 cvmx_fuse_read_byte(int addr)
 {
-	cvmx_mio_fus_rcmd_t mfr;
-
 	assert(current_target != NULL);
-
-	mfr.u64 = 0;
-	mfr.s.pend = 1;
-	mfr.s.addr = addr;
-	target_write_csr(current_target, CVMX_MIO_FUS_RCMD, mfr.u64);
-
-	for (;;) {
-		mfr.u64 = target_read_csr(current_target, CVMX_MIO_FUS_RCMD);
-		if (!mfr.s.pend)
-			break;
-	}
-
-	return (mfr.s.dat);
+	return (target_fuse_read_byte(current_target, addr));
 }
 
 int
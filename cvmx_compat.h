@@ -30,4 +30,12 @@ struct target;
 
 void cvmx_select_target(struct target *);
 
+/*
+ * Count of warnings the SDK has raised through cvmx_warn, such as for
+ * a CSR index out of range for the selected target's model, which
+ * only prints them and carries on with a bogus address.  Callers can
+ * compare it before and after to catch them.
+ */
+extern unsigned cvmx_warnings;
+
 #endif /* !CVMX_COMPAT_H */
@@ -0,0 +1,359 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <assert.h>
+#include <err.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cvmx.h>
+#include <cvmx-dpi-defs.h>
+
+#include "dma.h"
+#include "host.h"
+#include "link.h"
+#include "lock.h"
+#include "target.h"
+#include "timing.h"
+
+#ifndef	howmany
+#define	howmany(a)	(sizeof (a) / sizeof *(a))
+#endif
+
+/*
+ * Each transfer is split into batches of up to TARGET_DMA_DESCS
+ * instructions of TARGET_DMA_XFER bytes, all outstanding at once.
+ * The instructions for a batch are written to a single chunk at
+ * the start of the scratch area, followed by one completion word
+ * per instruction which the DPI clears when it is done.
+ *
+ * The queue is rewound to the start of the chunk before each batch,
+ * once the previous batch has completed, so the DPI never follows
+ * the chunk's next pointer or frees a chunk to the FPA.
+ */
+#define	TARGET_DMA_DESCS	(32)
+#define	TARGET_DMA_XFER		(4096)
+#define	TARGET_DMA_STAGING	(TARGET_DMA_DESCS * TARGET_DMA_XFER)
+#define	TARGET_DMA_INSTR_WORDS	(4)
+#define	TARGET_DMA_CHUNK_OFFSET	(0)
+#define	TARGET_DMA_CHUNK_WORDS	(256)
+#define	TARGET_DMA_DONE_OFFSET	(TARGET_DMA_CHUNK_WORDS * 8)
+#define	TARGET_DMA_TIMEOUT	(1000000)	/* Microseconds.  */
+
+/*
+ * Rather than polling the completion words across PCIe for the whole
+ * of a batch, sleep for as long as the link would take to carry it,
+ * assuming a Gen1 x1 link where the link is not known, and then poll
+ * every TARGET_DMA_POLL_DELAY.
+ */
+#define	TARGET_DMA_RATE_MIN	(250000000)	/* Bytes per second.  */
+#define	TARGET_DMA_POLL_DELAY	(20)		/* Microseconds.  */
+
+/*
+ * DPI instruction encodings, as in cvmx_dma_engine_header_t and
+ * cvmx_dma_engine_buffer_t in the SDK, whose header drags in too
+ * much target-only code to use here.  An INBOUND or OUTBOUND
+ * instruction is a header, NFST local pointers, and NLST PCIe
+ * pointers, the latter preceded by a word of lengths for each
+ * group of four.
+ */
+#define	DPI_HDR_LPORT_SHIFT	(56)
+#define	DPI_HDR_TYPE_SHIFT	(54)
+#define	DPI_HDR_TYPE_OUTBOUND	(0ull)	/* Target memory to host.  */
+#define	DPI_HDR_TYPE_INBOUND	(1ull)	/* Host to target memory.  */
+#define	DPI_HDR_II		(1ull << 49)
+#define	DPI_HDR_NLST_SHIFT	(44)
+#define	DPI_HDR_NFST_SHIFT	(40)
+#define	DPI_HDR_ADDR_MASK	((1ull << 40) - 1)
+
+#define	DPI_LOCAL_SIZE_SHIFT	(42)
+#define	DPI_LOCAL_ADDR_MASK	((1ull << 36) - 1)
+
+#define	DPI_PCIE_LEN0_SHIFT	(48)
+
+struct target_dma {
+	bool td_available;
+
+	size_t td_page_size;
+	uint8_t *td_staging;
+	uint64_t *td_staging_bus;
+};
+
+static struct target_dma *target_dma_attach(struct target *);
+static bool target_dma_transfer(struct target *, uint64_t, uint8_t *, size_t, bool);
+static void target_dma_rewind(struct target *);
+static void target_dma_sleep(uint64_t);
+
+bool
+target_dma_read(struct target *t, uint64_t addr, void *buf, size_t len)
+{
+	return (target_dma_transfer(t, addr, buf, len, false));
+}
+
+bool
+target_dma_write(struct target *t, uint64_t addr, const void *buf, size_t len)
+{
+	/*
+	 * The buffer is only read from for an inbound transfer.
+	 */
+	return (target_dma_transfer(t, addr, (uint8_t *)(uintptr_t)buf, len, true));
+}
+
+/*
+ * Set up DMA for a target the first time it is used, returning NULL
+ * if it is not available.  That requires a scratch area in target
+ * memory to have been configured, BAR1 to reach it, the DPI to have
+ * been enabled by software on the target, and the host to be able
+ * to provide staging memory.
+ */
+static struct target_dma *
+target_dma_attach(struct target *t)
+{
+	const struct target_csrs *tc;
+	cvmx_dpi_dmax_ibuff_saddr_t ddis;
+	cvmx_dpi_dma_control_t ddc;
+	cvmx_dpi_dma_engx_en_t dde;
+	struct target_dma *td;
+	cvmx_dpi_ctl_t dc;
+	unsigned e;
+
+	if (t->t_dma != NULL)
+		return (t->t_dma->td_available ? t->t_dma : NULL);
+
+	td = calloc(1, sizeof *td);
+	if (td == NULL)
+		err(1, "calloc");
+	t->t_dma = td;
+
+	tc = &t->t_csrs;
+
+	if (target_dma_scratch == 0 || !t->t_pci_bar[1].tb_enabled)
+		return (NULL);
+
+	dc.u64 = target_read_csr(t, tc->tc_dpi_ctl);
+	if (!dc.s.en) {
+		fprintf(stderr, "target%u: DPI not enabled; not using DMA\n", t->t_unit);
+		return (NULL);
+	}
+
+	ddis.u64 = target_read_csr(t, tc->tc_dpi_dmax_ibuff_saddr);
+	if (!ddis.s.idle) {
+		fprintf(stderr, "target%u: DMA queue %u busy; not using DMA\n", t->t_unit, TARGET_DMA_QUEUE);
+		return (NULL);
+	}
+
+	/*
+	 * Our queue is serviced only by engines software on the
+	 * target has already enabled; without any, a transfer
+	 * would never complete.
+	 */
+	ddc.u64 = target_read_csr(t, tc->tc_dpi_dma_control);
+	if ((ddc.s.dma_enb & ((1u << howmany(tc->tc_dpi_dma_engx_en)) - 1)) == 0) {
+		fprintf(stderr, "target%u: no DMA engines enabled; not using DMA\n", t->t_unit);
+		return (NULL);
+	}
+
+	td->td_page_size = getpagesize();
+	assert(td->td_page_size % TARGET_DMA_XFER == 0);
+	assert(TARGET_DMA_STAGING % td->td_page_size == 0);
+
+	td->td_staging_bus = calloc(TARGET_DMA_STAGING / td->td_page_size, sizeof *td->td_staging_bus);
+	if (td->td_staging_bus == NULL)
+		err(1, "calloc");
+	td->td_staging = host_dma_alloc(TARGET_DMA_STAGING, td->td_staging_bus);
+	if (td->td_staging == NULL) {
+		fprintf(stderr, "target%u: host cannot provide DMA memory; not using DMA\n", t->t_unit);
+		return (NULL);
+	}
+
+	target_dma_rewind(t);
+
+	/*
+	 * Let each enabled engine service our queue as well as
+	 * whichever queues software on the target has assigned it.
+	 * The assignment is left in place when we exit.
+	 */
+	for (e = 0; e < howmany(tc->tc_dpi_dma_engx_en); e++) {
+		if ((ddc.s.dma_enb & (1u << e)) == 0)
+			continue;
+		dde.u64 = target_read_csr(t, tc->tc_dpi_dma_engx_en[e]);
+		dde.s.qen |= 1u << TARGET_DMA_QUEUE;
+		target_write_csr(t, tc->tc_dpi_dma_engx_en[e], dde.u64);
+	}
+
+	td->td_available = true;
+	return (td);
+}
+
+static bool
+target_dma_transfer(struct target *t, uint64_t addr, uint8_t *buf, size_t len, bool inbound)
+{
+	uint64_t instr[TARGET_DMA_DESCS * TARGET_DMA_INSTR_WORDS];
+	uint64_t done[TARGET_DMA_DESCS];
+	cvmx_dpi_dmax_dbell_t ddd;
+	uint64_t bus, deadline, hdr, rate;
+	unsigned i, j, ndescs;
+	struct target_dma *td;
+	size_t n, offset;
+	bool complete;
+	uint8_t *p;
+
+	/*
+	 * Our queue and scratch area are shared with any other
+	 * process using DMA on this target, so hold them for the
+	 * whole transfer.
+	 */
+	target_lock(t, TARGET_LOCK_DMA);
+	td = target_dma_attach(t);
+	if (td == NULL) {
+		target_unlock(t, TARGET_LOCK_DMA);
+		return (false);
+	}
+
+	while (len != 0) {
+		n = len < TARGET_DMA_STAGING ? len : TARGET_DMA_STAGING;
+		ndescs = (n + TARGET_DMA_XFER - 1) / TARGET_DMA_XFER;
+
+		if (inbound)
+			memcpy(td->td_staging, buf, n);
+
+		hdr = (uint64_t)t->t_pcie_port << DPI_HDR_LPORT_SHIFT;
+		hdr |= 1ull << DPI_HDR_NFST_SHIFT;
+		hdr |= 1ull << DPI_HDR_NLST_SHIFT;
+		if (inbound) {
+			hdr |= DPI_HDR_TYPE_INBOUND << DPI_HDR_TYPE_SHIFT;
+		} else {
+			/*
+			 * Never free the local buffer to the FPA.
+			 */
+			hdr |= DPI_HDR_TYPE_OUTBOUND << DPI_HDR_TYPE_SHIFT;
+			hdr |= DPI_HDR_II;
+		}
+
+		for (i = 0; i < ndescs; i++) {
+			uint64_t *w;
+			size_t xfer;
+
+			offset = (size_t)i * TARGET_DMA_XFER;
+			xfer = n - offset < TARGET_DMA_XFER ? n - offset : TARGET_DMA_XFER;
+			bus = td->td_staging_bus[offset / td->td_page_size] + offset % td->td_page_size;
+
+			w = &instr[i * TARGET_DMA_INSTR_WORDS];
+			w[0] = hdr | ((target_dma_scratch + TARGET_DMA_DONE_OFFSET + i * sizeof done[0]) & DPI_HDR_ADDR_MASK);
+			w[1] = (uint64_t)xfer << DPI_LOCAL_SIZE_SHIFT | ((addr + offset) & DPI_LOCAL_ADDR_MASK);
+			w[2] = (uint64_t)xfer << DPI_PCIE_LEN0_SHIFT;
+			w[3] = bus;
+			for (j = 0; j < TARGET_DMA_INSTR_WORDS; j++)
+				w[j] = htobe64(w[j]);
+		}
+
+		/*
+		 * Each instruction clears one byte of its completion
+		 * word; which byte depends on DPI_DMA_CONTROL[B0_LEND],
+		 * so set them all and look for any being cleared.
+		 *
+		 * These small writes go through BAR1, below the
+		 * threshold at which target_mem_write uses DMA.
+		 */
+		memset(done, 0xff, ndescs * sizeof done[0]);
+		target_mem_write(t, target_dma_scratch + TARGET_DMA_DONE_OFFSET, done, ndescs * sizeof done[0]);
+		target_mem_write(t, target_dma_scratch + TARGET_DMA_CHUNK_OFFSET, instr, ndescs * TARGET_DMA_INSTR_WORDS * sizeof instr[0]);
+
+		target_dma_rewind(t);
+
+		ddd.u64 = 0;
+		ddd.s.dbell_cnt = ndescs * TARGET_DMA_INSTR_WORDS;
+		target_write_csr(t, t->t_csrs.tc_dpi_dmax_dbell, ddd.u64);
+
+		deadline = timing_now() + TARGET_DMA_TIMEOUT;
+		rate = target_link_rate(t);
+		if (rate == 0)
+			rate = TARGET_DMA_RATE_MIN;
+		target_dma_sleep((uint64_t)n * 1000000 / rate);
+		for (;;) {
+			target_mem_read(t, target_dma_scratch + TARGET_DMA_DONE_OFFSET, done, ndescs * sizeof done[0]);
+
+			complete = true;
+			for (i = 0; i < ndescs && complete; i++) {
+				p = (uint8_t *)&done[i];
+				for (j = 0; j < sizeof done[i]; j++) {
+					if (p[j] == 0)
+						break;
+				}
+				if (j == sizeof done[i])
+					complete = false;
+			}
+			if (complete)
+				break;
+
+			if (timing_now() > deadline)
+				errx(1, "target%u: DMA transfer timed out.", t->t_unit);
+			target_dma_sleep(TARGET_DMA_POLL_DELAY);
+		}
+
+		if (!inbound)
+			memcpy(buf, td->td_staging, n);
+
+		addr += n;
+		buf += n;
+		len -= n;
+	}
+	target_unlock(t, TARGET_LOCK_DMA);
+
+	return (true);
+}
+
+/*
+ * Point the queue back at the start of our instruction chunk.  The
+ * queue must be idle.
+ */
+static void
+target_dma_rewind(struct target *t)
+{
+	cvmx_dpi_dmax_ibuff_saddr_t ddis;
+
+	ddis.u64 = 0;
+	ddis.s.csize = TARGET_DMA_CHUNK_WORDS;
+	ddis.s.saddr = (target_dma_scratch + TARGET_DMA_CHUNK_OFFSET) >> 7;
+	target_write_csr(t, t->t_csrs.tc_dpi_dmax_ibuff_saddr, ddis.u64);
+}
+
+static void
+target_dma_sleep(uint64_t us)
+{
+	struct timespec ts;
+
+	ts.tv_sec = us / 1000000;
+	ts.tv_nsec = (long)(us % 1000000) * 1000;
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+		continue;
+}
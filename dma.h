@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	DMA_H
+#define	DMA_H
+
+struct target;
+
+/*
+ * The DPI instruction queue we drive from the host.  Queues are
+ * shared with software on the target, so use the last one.
+ */
+#define	TARGET_DMA_QUEUE	(7)
+
+/*
+ * Size of the target memory scratch area, at target_dma_scratch,
+ * which holds our instruction chunk and completion words.
+ */
+#define	TARGET_DMA_SCRATCH_SIZE	(4096)
+
+/*
+ * Transfer between host and target memory with the DPI DMA engine.
+ * These return false, having transferred nothing, if DMA is not
+ * available for the target, in which case the caller should fall
+ * back to programmed I/O.
+ */
+bool target_dma_read(struct target *, uint64_t, void *, size_t);
+bool target_dma_write(struct target *, uint64_t, const void *, size_t);
+
+#endif /* !DMA_H */
@@ -24,20 +24,23 @@
  */
 
 #include <sys/types.h>
-#include <sys/endian.h>
 #include <assert.h>
 #include <stdbool.h>
-
-#include <cvmx.h>
-#include <cvmx-twsi.h>
+#include <stdint.h>
+#include <string.h>
 
 #include "eeprom.h"
+#include "host.h"
 #include "target.h"
+#include "twsi.h"
 
 #ifndef	howmany
 #define	howmany(a)	(sizeof (a) / sizeof *(a))
 #endif
 
+#define	EEPROM_TWSI_BUS		(0)
+#define	EEPROM_TWSI_IA_WIDTH	(16)
+
 /*
  * EEPROM addresses to scan looking for tuples.
  */
@@ -45,39 +48,53 @@ static const uint8_t eeprom_tuple_scan[] = {
 	0x52, 0x53, 0x56, 0x54
 };
 
-static bool eeprom_tuple_find(uint8_t, uint16_t, uint8_t, void *, size_t);
+static bool eeprom_tuple_find(struct target *, uint8_t, uint16_t, uint8_t, void *, size_t);
 
 bool
-eeprom_board_desc_read(struct eeprom_board_desc *ebd)
+eeprom_board_desc_read(struct target *t, struct eeprom_board_desc *ebd)
 {
+	uint8_t probe;
 	unsigned i;
-
-	for (i = 0; i < howmany(eeprom_tuple_scan); i++) {
-		if (!eeprom_tuple_find(eeprom_tuple_scan[i], EEPROM_TUPLE_TYPE_BOARD_DESC, EEPROM_BOARD_DESC_MAJOR, ebd, sizeof *ebd))
+	bool found;
+
+	found = false;
+	for (i = 0; !found && i < howmany(eeprom_tuple_scan); i++) {
+		/*
+		 * Look for the EEPROM with a single byte read at the
+		 * slow clock, and once it is found, raise the clock
+		 * as far as the board allows before walking its tuples.
+		 * The fast clock is only known to suit the EEPROM, so
+		 * the bus goes back to the slow clock afterwards.
+		 */
+		if (!target_twsi_read(t, EEPROM_TWSI_BUS, eeprom_tuple_scan[i], EEPROM_TWSI_IA_WIDTH, 0, &probe, sizeof probe))
 			continue;
+		(void)target_twsi_negotiate(t, EEPROM_TWSI_BUS, eeprom_tuple_scan[i], EEPROM_TWSI_IA_WIDTH, 0);
 
-		ebd->ebd_board_type = be16toh(ebd->ebd_board_type);
-		return (true);
+		found = eeprom_tuple_find(t, eeprom_tuple_scan[i], EEPROM_TUPLE_TYPE_BOARD_DESC, EEPROM_BOARD_DESC_MAJOR, ebd, sizeof *ebd);
+		target_twsi_slow(t, EEPROM_TWSI_BUS);
 	}
-	return (false);
+	if (!found)
+		return (false);
+
+	ebd->ebd_board_type = be16toh(ebd->ebd_board_type);
+	return (true);
 }
 
 static bool
-eeprom_tuple_find(uint8_t twsi, uint16_t type, uint8_t major, void *data, size_t len)
+eeprom_tuple_find(struct target *t, uint8_t twsi, uint16_t type, uint8_t major, void *data, size_t len)
 {
 	struct eeprom_tuple_header eth;
 	uint8_t eth_data[sizeof eth];
 	uint8_t raw_data[256];
 	uint16_t start;
-	unsigned i;
 
 	assert(sizeof raw_data >= len);
 
 	start = 0;
 
 	for (;;) {
-		for (i = 0; i < sizeof eth_data; i++)
-			eth_data[i] = (uint8_t)cvmx_twsix_read_ia16(0, twsi, start + i, 1);
+		if (!target_twsi_read(t, EEPROM_TWSI_BUS, twsi, EEPROM_TWSI_IA_WIDTH, start, eth_data, sizeof eth_data))
+			return (false);
 
 		memcpy(&eth, eth_data, sizeof eth);
 		eth.eth_type = be16toh(eth.eth_type);
@@ -86,14 +103,16 @@ eeprom_tuple_find(uint8_t twsi, uint16_t type, uint8_t major, void *data, size_t
 
 		if (eth.eth_type == EEPROM_TUPLE_TYPE_END)
 			return (false);
+		if (eth.eth_length < sizeof eth)
+			return (false);
 
 		start += sizeof eth;
 		eth.eth_length -= sizeof eth;
 
 		if (eth.eth_type == type && eth.eth_major == major &&
 		    eth.eth_length == len) {
-			for (i = 0; i < len; i++)
-				raw_data[i] = (uint8_t)cvmx_twsix_read_ia16(0, twsi, start + i, 1);
+			if (!target_twsi_read(t, EEPROM_TWSI_BUS, twsi, EEPROM_TWSI_IA_WIDTH, start, raw_data, len))
+				return (false);
 
 			memcpy(data, raw_data, len);
 			return (true);
@@ -26,6 +26,8 @@
 #ifndef	EEPROM_H
 #define	EEPROM_H
 
+struct target;
+
 #define	EEPROM_TUPLE_TYPE_BOARD_DESC	(0x0002)
 #define	EEPROM_TUPLE_TYPE_MAC_ADDR	(0x0004)
 #define	EEPROM_TUPLE_TYPE_END		(0xffff)
@@ -54,7 +56,7 @@ struct eeprom_board_desc {
 	uint8_t ebd_serial[EEPROM_BOARD_DESC_SERIAL_LEN];
 };
 
-bool eeprom_board_desc_read(struct eeprom_board_desc *);
+bool eeprom_board_desc_read(struct target *, struct eeprom_board_desc *);
 
 /*
  * MAC address allocation.
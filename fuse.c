@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <cvmx.h>
+
+#include "fuse.h"
+#include "host.h"
+#include "lock.h"
+#include "target.h"
+
+static uint8_t target_fuse_fetch(struct target *, unsigned);
+
+uint8_t
+target_fuse_read_byte(struct target *t, unsigned addr)
+{
+	uint8_t b;
+
+	if (addr >= TARGET_FUSE_BYTES) {
+		target_lock(t, TARGET_LOCK_FUSE);
+		b = target_fuse_fetch(t, addr);
+		target_unlock(t, TARGET_LOCK_FUSE);
+		return (b);
+	}
+
+	if ((t->t_fuses_valid[addr / 64] & (1ull << (addr % 64))) == 0) {
+		target_lock(t, TARGET_LOCK_FUSE);
+		t->t_fuses[addr] = target_fuse_fetch(t, addr);
+		target_unlock(t, TARGET_LOCK_FUSE);
+		t->t_fuses_valid[addr / 64] |= 1ull << (addr % 64);
+	}
+	return (t->t_fuses[addr]);
+}
+
+/*
+ * Print the whole fuse bank, reading whatever is not yet cached with
+ * the fuse lock held once for the lot.
+ */
+void
+target_fuse_dump(struct target *t)
+{
+	unsigned addr, i;
+
+	target_lock(t, TARGET_LOCK_FUSE);
+	for (addr = 0; addr < TARGET_FUSE_BYTES; addr++) {
+		if ((t->t_fuses_valid[addr / 64] & (1ull << (addr % 64))) != 0)
+			continue;
+		t->t_fuses[addr] = target_fuse_fetch(t, addr);
+		t->t_fuses_valid[addr / 64] |= 1ull << (addr % 64);
+	}
+	target_unlock(t, TARGET_LOCK_FUSE);
+
+	for (addr = 0; addr < TARGET_FUSE_BYTES; addr += 16) {
+		printf("target%u: fuses %04u-%04u:", t->t_unit, addr * 8, (addr + 16) * 8 - 1);
+		for (i = addr; i < addr + 16; i++)
+			printf(" %02x", t->t_fuses[i]);
+		printf("\n");
+	}
+}
+
+/*
+ * Read a fuse byte from the hardware.  The read is usually complete
+ * by the time the window read which follows the request arrives, so
+ * polling rarely takes more than the one read.  Called with
+ * TARGET_LOCK_FUSE held, since MIO_FUS_RCMD holds a single request.
+ */
+static uint8_t
+target_fuse_fetch(struct target *t, unsigned addr)
+{
+	cvmx_mio_fus_rcmd_t mfr;
+
+	mfr.u64 = 0;
+	mfr.s.pend = 1;
+	mfr.s.addr = addr;
+	target_write_csr(t, t->t_csrs.tc_mio_fus_rcmd, mfr.u64);
+
+	for (;;) {
+		mfr.u64 = target_read_csr(t, t->t_csrs.tc_mio_fus_rcmd);
+		if (!mfr.s.pend)
+			break;
+	}
+
+	return (mfr.s.dat);
+}
@@ -26,6 +26,13 @@
 #ifndef	GLOBAL_H
 #define	GLOBAL_H
 
+/* Byte-order conversion lives in a different header on Linux.  */
+#ifdef __linux__
+#include <endian.h>
+#else
+#include <sys/endian.h>
+#endif
+
 /* We do not need to map IO addresses.  */
 #define	CVMX_ADD_IO_SEG(a)	(a)
 
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	HOST_H
+#define	HOST_H
+
+/*
+ * Host backends find PCI devices and map their BARs.  Exactly one
+ * backend is built, chosen by the host operating system.
+ */
+
+struct host_pci_id {
+	uint16_t hpi_vendor;
+	uint16_t hpi_device;
+};
+
+struct host_pci_dev {
+	uint32_t hpd_domain;
+	uint8_t hpd_bus;
+	uint8_t hpd_slot;
+	uint8_t hpd_function;
+
+	uint16_t hpd_vendor;
+	uint16_t hpd_device;
+};
+
+struct host_bar {
+	bool hb_memory;
+	bool hb_prefetchable;
+
+	uint64_t hb_base;
+	uint64_t hb_length;
+};
+
+typedef void host_pci_attach_t(const struct host_pci_dev *);
+
+/*
+ * Call the attach function for each device matching one of the given
+ * IDs, in bus order.
+ */
+void host_pci_enumerate(const struct host_pci_id *, unsigned, host_pci_attach_t *);
+
+/*
+ * Describe BAR register n (not the logical BAR number used elsewhere)
+ * of a device.  Returns false if the BAR is not enabled.
+ */
+bool host_pci_bar(const struct host_pci_dev *, unsigned, struct host_bar *);
+
+/*
+ * Map a memory BAR described by host_pci_bar, optionally
+ * write-combining.  Returns NULL if it cannot be mapped at all; the
+ * final argument reports whether write-combining was achieved.
+ */
+void *host_pci_bar_map(const struct host_pci_dev *, unsigned, const struct host_bar *, bool, bool *);
+
+/*
+ * Read len bytes of a device's configuration space, starting at
+ * reg, both multiples of four, in the order they appear in
+ * configuration space.  Returns false if the host will not let us
+ * read that far, as Linux does beyond the standard header for
+ * unprivileged processes.
+ */
+bool host_pci_config_read(const struct host_pci_dev *, unsigned, void *, size_t);
+
+/*
+ * Allocate wired, page-aligned host memory which a device may access
+ * by DMA, filling in the bus address of each host page.  Returns NULL
+ * where the host cannot provide such memory to a user process.
+ */
+void *host_dma_alloc(size_t, uint64_t *);
+void host_dma_free(void *, size_t);
+
+#endif /* !HOST_H */
@@ -0,0 +1,335 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#if defined(__amd64__) || defined(__i386__)
+#include <sys/memrange.h>
+#endif
+#include <sys/mman.h>
+#include <sys/pciio.h>
+#include <dev/pci/pcireg.h>
+#include <assert.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+
+/*
+ * Number of PCIOCGETCONF matches to fetch per call; enumeration
+ * pages through as many calls as there are matching devices.
+ */
+#define	HOST_MATCH_PAGE	(32)
+
+static int host_pci_fd = -1;
+static int host_pci_rw_fd = -1;		/* For PCIOCREAD, which needs FWRITE.  */
+static int host_mem_fd = -1;
+
+static bool host_bar_write_combine(const struct host_bar *);
+#if defined(__amd64__) || defined(__i386__)
+static bool host_bar_range_is_wc(const struct host_bar *);
+#endif
+
+void
+host_pci_enumerate(const struct host_pci_id *ids, unsigned nids, host_pci_attach_t *attach)
+{
+	struct pci_conf pcs[HOST_MATCH_PAGE];
+	struct pci_match_conf *pmc;
+	struct host_pci_dev hpd;
+	struct pci_conf_io pci;
+	unsigned i;
+	int rv;
+
+	memset(&pci, 0, sizeof pci);
+
+	if (host_pci_fd == -1) {
+		host_pci_fd = open("/dev/pci", O_RDONLY);
+		if (host_pci_fd == -1)
+			err(1, "open /dev/pci");
+	}
+
+	pci.match_buf_len = sizeof pcs;
+	pci.matches = pcs;
+
+	pmc = calloc(nids, sizeof *pmc);
+	if (pmc == NULL)
+		err(1, "calloc");
+
+	for (i = 0; i < nids; i++) {
+		pmc[i].pc_vendor = ids[i].hpi_vendor;
+		pmc[i].pc_device = ids[i].hpi_device;
+		pmc[i].flags = PCI_GETCONF_MATCH_VENDOR | PCI_GETCONF_MATCH_DEVICE;
+	}
+
+	pci.num_patterns = nids;
+	pci.pat_buf_len = nids * sizeof *pmc;
+	pci.patterns = pmc;
+
+	/*
+	 * The kernel updates the offset and generation in pci
+	 * after each call, so repeating the ioctl resumes where
+	 * the previous page of matches left off.
+	 */
+	do {
+		rv = ioctl(host_pci_fd, PCIOCGETCONF, &pci);
+		if (rv == -1)
+			err(1, "ioctl PCIOCGETCONF");
+
+		switch (pci.status) {
+		case PCI_GETCONF_LAST_DEVICE:
+		case PCI_GETCONF_MORE_DEVS:
+			break;
+		case PCI_GETCONF_LIST_CHANGED:
+			errx(1, "PCI device list changed during enumeration.");
+		default:
+			errx(1, "ioctl PCIOCGETCONF failed with status %d.", pci.status);
+		}
+
+		for (i = 0; i < pci.num_matches; i++) {
+			memset(&hpd, 0, sizeof hpd);
+			hpd.hpd_domain = pcs[i].pc_sel.pc_domain;
+			hpd.hpd_bus = pcs[i].pc_sel.pc_bus;
+			hpd.hpd_slot = pcs[i].pc_sel.pc_dev;
+			hpd.hpd_function = pcs[i].pc_sel.pc_func;
+			hpd.hpd_vendor = pcs[i].pc_vendor;
+			hpd.hpd_device = pcs[i].pc_device;
+
+			attach(&hpd);
+		}
+	} while (pci.status == PCI_GETCONF_MORE_DEVS);
+
+	free(pmc);
+}
+
+bool
+host_pci_bar(const struct host_pci_dev *hpd, unsigned n, struct host_bar *hb)
+{
+	struct pci_bar_io pbi;
+	int rv;
+
+	assert(host_pci_fd != -1);
+
+	memset(&pbi, 0, sizeof pbi);
+	pbi.pbi_sel.pc_domain = hpd->hpd_domain;
+	pbi.pbi_sel.pc_bus = hpd->hpd_bus;
+	pbi.pbi_sel.pc_dev = hpd->hpd_slot;
+	pbi.pbi_sel.pc_func = hpd->hpd_function;
+	pbi.pbi_reg = PCIR_BAR(n);
+
+	rv = ioctl(host_pci_fd, PCIOCGETBAR, &pbi);
+	if (rv == -1 || pbi.pbi_enabled == 0)
+		return (false);
+
+	memset(hb, 0, sizeof *hb);
+	hb->hb_memory = PCI_BAR_MEM(pbi.pbi_base);
+	if (!hb->hb_memory)
+		return (true);
+	hb->hb_prefetchable = (pbi.pbi_base & PCIM_BAR_MEM_PREFETCH) != 0;
+	hb->hb_base = pbi.pbi_base & PCIM_BAR_MEM_BASE;
+	hb->hb_length = pbi.pbi_length;
+	return (true);
+}
+
+void *
+host_pci_bar_map(const struct host_pci_dev *hpd, unsigned n, const struct host_bar *hb, bool wc, bool *wcp)
+{
+	void *m;
+
+	(void)hpd;
+	(void)n;
+
+	assert(hb->hb_memory);
+
+	if (host_mem_fd == -1) {
+		host_mem_fd = open("/dev/mem", O_RDWR);
+		if (host_mem_fd == -1)
+			err(1, "open /dev/mem");
+	}
+
+	m = mmap(NULL, hb->hb_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NOCORE, host_mem_fd, hb->hb_base);
+	if (m == MAP_FAILED)
+		return (NULL);
+
+	*wcp = wc && host_bar_write_combine(hb);
+	return (m);
+}
+
+bool
+host_pci_config_read(const struct host_pci_dev *hpd, unsigned reg, void *buf, size_t len)
+{
+	struct pci_io pi;
+	uint8_t *p;
+	unsigned i;
+	size_t j;
+
+	assert(reg % 4 == 0 && len % 4 == 0);
+
+	if (host_pci_rw_fd == -1) {
+		host_pci_rw_fd = open("/dev/pci", O_RDWR);
+		if (host_pci_rw_fd == -1)
+			return (false);
+	}
+
+	p = buf;
+	for (j = 0; j < len; j += 4) {
+		memset(&pi, 0, sizeof pi);
+		pi.pi_sel.pc_domain = hpd->hpd_domain;
+		pi.pi_sel.pc_bus = hpd->hpd_bus;
+		pi.pi_sel.pc_dev = hpd->hpd_slot;
+		pi.pi_sel.pc_func = hpd->hpd_function;
+		pi.pi_reg = reg + j;
+		pi.pi_width = 4;
+		if (ioctl(host_pci_rw_fd, PCIOCREAD, &pi) == -1)
+			return (false);
+		for (i = 0; i < 4; i++)
+			p[j + i] = pi.pi_data >> (8 * i);
+	}
+	return (true);
+}
+
+/*
+ * FreeBSD gives a user process no way to learn the physical
+ * address of its memory, so DMA staging buffers cannot be
+ * provided here, and callers fall back to programmed I/O.
+ */
+void *
+host_dma_alloc(size_t len, uint64_t *bus)
+{
+	(void)len;
+	(void)bus;
+	return (NULL);
+}
+
+void
+host_dma_free(void *m, size_t len)
+{
+	(void)m;
+	(void)len;
+}
+
+/*
+ * Make a mapped BAR write-combining by adding a memory range
+ * descriptor for its physical range.  This is only possible
+ * on hosts with MTRRs, and the BAR must be prefetchable and
+ * aligned to its size, as an MTRR range must be.  The range
+ * is host-wide and persists after we exit; we leave it, since
+ * other bsdoct processes may be relying on it, and later runs
+ * find it already in place.
+ */
+static bool
+host_bar_write_combine(const struct host_bar *hb)
+{
+#if defined(__amd64__) || defined(__i386__)
+	struct mem_range_desc mrd;
+	struct mem_range_op mro;
+	int rv;
+
+	if (!hb->hb_prefetchable)
+		return (false);
+	if (hb->hb_length == 0 || (hb->hb_length & (hb->hb_length - 1)) != 0 ||
+	    (hb->hb_base & (hb->hb_length - 1)) != 0) {
+		warnx("BAR at %#jx size %#jx cannot be covered by an MTRR range", (uintmax_t)hb->hb_base, (uintmax_t)hb->hb_length);
+		return (false);
+	}
+
+	memset(&mrd, 0, sizeof mrd);
+	mrd.mr_base = hb->hb_base;
+	mrd.mr_len = hb->hb_length;
+	mrd.mr_flags = MDF_WRITECOMBINE;
+	strlcpy(mrd.mr_owner, "bsdoct", sizeof mrd.mr_owner);
+
+	memset(&mro, 0, sizeof mro);
+	mro.mo_desc = &mrd;
+	mro.mo_arg[0] = MEMRANGE_SET_UPDATE;
+
+	rv = ioctl(host_mem_fd, MEMRANGE_SET, &mro);
+	if (rv == -1 && errno == EEXIST)
+		return (host_bar_range_is_wc(hb));
+	if (rv == -1) {
+		warn("MEMRANGE_SET %#jx", (uintmax_t)hb->hb_base);
+		return (false);
+	}
+	return (true);
+#else
+	(void)hb;
+	return (false);
+#endif
+}
+
+#if defined(__amd64__) || defined(__i386__)
+/*
+ * A range already covering the BAR may have been set up by an
+ * earlier run, or by someone else with another attribute, so
+ * check that it is write-combining.
+ */
+static bool
+host_bar_range_is_wc(const struct host_bar *hb)
+{
+	struct mem_range_desc *mrds;
+	struct mem_range_op mro;
+	bool wc;
+	int i, n;
+
+	memset(&mro, 0, sizeof mro);
+	if (ioctl(host_mem_fd, MEMRANGE_GET, &mro) == -1) {
+		warn("MEMRANGE_GET");
+		return (false);
+	}
+	n = mro.mo_arg[0];
+	if (n <= 0)
+		return (false);
+
+	mrds = calloc(n, sizeof *mrds);
+	if (mrds == NULL)
+		err(1, "calloc");
+	mro.mo_desc = mrds;
+	mro.mo_arg[0] = n;
+	if (ioctl(host_mem_fd, MEMRANGE_GET, &mro) == -1) {
+		warn("MEMRANGE_GET");
+		free(mrds);
+		return (false);
+	}
+
+	wc = false;
+	for (i = 0; i < n; i++) {
+		if ((mrds[i].mr_flags & MDF_ACTIVE) == 0)
+			continue;
+		if (mrds[i].mr_base != hb->hb_base || mrds[i].mr_len != hb->hb_length)
+			continue;
+		wc = (mrds[i].mr_flags & MDF_ATTRMASK) == MDF_WRITECOMBINE;
+		break;
+	}
+	free(mrds);
+
+	if (!wc)
+		warnx("memory range at %#jx exists but is not write-combining", (uintmax_t)hb->hb_base);
+	return (wc);
+}
+#endif
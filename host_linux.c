@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <assert.h>
+#include <dirent.h>
+#include <err.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "host.h"
+
+/*
+ * PCI devices are found and mapped through sysfs.  The root of the
+ * sysfs tree may be overridden with BSDOCT_SYSFS_ROOT, which allows a
+ * fake tree with file-backed resourceN files to stand in for real
+ * hardware.
+ */
+#define	HOST_SYSFS_ROOT_DEFAULT	"/sys"
+#define	HOST_SYSFS_DEVICES	"bus/pci/devices"
+
+/* Flags from the sysfs resource file, per linux/ioport.h.  */
+#define	HOST_IORESOURCE_MEM		(0x00000200)
+#define	HOST_IORESOURCE_PREFETCH	(0x00002000)
+
+static const char *host_sysfs_root(void);
+static bool host_sysfs_read_hex(const struct host_pci_dev *, const char *, uint64_t *);
+static void host_sysfs_path(char *, size_t, const struct host_pci_dev *, const char *);
+static int host_pci_dev_compare(const void *, const void *);
+
+void
+host_pci_enumerate(const struct host_pci_id *ids, unsigned nids, host_pci_attach_t *attach)
+{
+	struct host_pci_dev *devs, hpd;
+	unsigned domain, bus, slot, function;
+	unsigned i, ndevs, sdevs;
+	uint64_t vendor, device;
+	char path[PATH_MAX];
+	struct dirent *de;
+	DIR *dir;
+
+	snprintf(path, sizeof path, "%s/%s", host_sysfs_root(), HOST_SYSFS_DEVICES);
+	dir = opendir(path);
+	if (dir == NULL)
+		err(1, "opendir %s", path);
+
+	devs = NULL;
+	ndevs = 0;
+	sdevs = 0;
+
+	while ((de = readdir(dir)) != NULL) {
+		if (sscanf(de->d_name, "%x:%x:%x.%x", &domain, &bus, &slot, &function) != 4)
+			continue;
+
+		memset(&hpd, 0, sizeof hpd);
+		hpd.hpd_domain = domain;
+		hpd.hpd_bus = bus;
+		hpd.hpd_slot = slot;
+		hpd.hpd_function = function;
+
+		if (!host_sysfs_read_hex(&hpd, "vendor", &vendor) ||
+		    !host_sysfs_read_hex(&hpd, "device", &device))
+			continue;
+		hpd.hpd_vendor = vendor;
+		hpd.hpd_device = device;
+
+		for (i = 0; i < nids; i++) {
+			if (hpd.hpd_vendor == ids[i].hpi_vendor &&
+			    hpd.hpd_device == ids[i].hpi_device)
+				break;
+		}
+		if (i == nids)
+			continue;
+
+		if (ndevs == sdevs) {
+			sdevs = sdevs == 0 ? 16 : sdevs * 2;
+			devs = reallocarray(devs, sdevs, sizeof *devs);
+			if (devs == NULL)
+				err(1, "reallocarray");
+		}
+		devs[ndevs++] = hpd;
+	}
+	closedir(dir);
+
+	/*
+	 * readdir returns devices in no particular order; sort
+	 * them so that unit numbers follow the bus as they do on
+	 * other hosts.
+	 */
+	if (ndevs != 0)
+		qsort(devs, ndevs, sizeof *devs, host_pci_dev_compare);
+	for (i = 0; i < ndevs; i++)
+		attach(&devs[i]);
+	free(devs);
+}
+
+bool
+host_pci_bar(const struct host_pci_dev *hpd, unsigned n, struct host_bar *hb)
+{
+	uint64_t start, end, flags;
+	char path[PATH_MAX];
+	unsigned line;
+	bool found;
+	FILE *f;
+
+	host_sysfs_path(path, sizeof path, hpd, "resource");
+	f = fopen(path, "r");
+	if (f == NULL)
+		return (false);
+
+	found = false;
+	for (line = 0; ; line++) {
+		if (fscanf(f, "%" SCNx64 " %" SCNx64 " %" SCNx64, &start, &end, &flags) != 3)
+			break;
+		if (line == n) {
+			found = true;
+			break;
+		}
+	}
+	fclose(f);
+
+	if (!found || (start == 0 && end == 0))
+		return (false);
+
+	memset(hb, 0, sizeof *hb);
+	hb->hb_memory = (flags & HOST_IORESOURCE_MEM) != 0;
+	if (!hb->hb_memory)
+		return (true);
+	hb->hb_prefetchable = (flags & HOST_IORESOURCE_PREFETCH) != 0;
+	hb->hb_base = start;
+	hb->hb_length = end - start + 1;
+	return (true);
+}
+
+/*
+ * Map resourceN, or resourceN_wc if write-combining is wanted and the
+ * kernel provides it, which it does for prefetchable BARs on hosts
+ * which support write-combining.
+ */
+void *
+host_pci_bar_map(const struct host_pci_dev *hpd, unsigned n, const struct host_bar *hb, bool wc, bool *wcp)
+{
+	char path[PATH_MAX], name[32];
+	void *m;
+	int fd;
+
+	assert(hb->hb_memory);
+
+	fd = -1;
+	*wcp = false;
+
+	if (wc && hb->hb_prefetchable) {
+		snprintf(name, sizeof name, "resource%u_wc", n);
+		host_sysfs_path(path, sizeof path, hpd, name);
+		fd = open(path, O_RDWR | O_SYNC);
+		if (fd != -1)
+			*wcp = true;
+	}
+
+	if (fd == -1) {
+		snprintf(name, sizeof name, "resource%u", n);
+		host_sysfs_path(path, sizeof path, hpd, name);
+		fd = open(path, O_RDWR | O_SYNC);
+		if (fd == -1) {
+			warn("open %s", path);
+			return (NULL);
+		}
+	}
+
+	m = mmap(NULL, hb->hb_length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (m == MAP_FAILED) {
+		*wcp = false;
+		return (NULL);
+	}
+	return (m);
+}
+
+bool
+host_pci_config_read(const struct host_pci_dev *hpd, unsigned reg, void *buf, size_t len)
+{
+	char path[PATH_MAX];
+	ssize_t rv;
+	int fd;
+
+	assert(reg % 4 == 0 && len % 4 == 0);
+
+	host_sysfs_path(path, sizeof path, hpd, "config");
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return (false);
+	rv = pread(fd, buf, len, reg);
+	close(fd);
+	return (rv >= 0 && (size_t)rv == len);
+}
+
+/*
+ * Wired anonymous memory, with bus addresses taken from the physical
+ * frame numbers in /proc/self/pagemap, which requires CAP_SYS_ADMIN.
+ * This assumes bus and physical addresses are the same, which is not
+ * the case behind an IOMMU in translating mode.
+ */
+void *
+host_dma_alloc(size_t len, uint64_t *bus)
+{
+	size_t i, pagesize;
+	uint64_t entry;
+	ssize_t rv;
+	void *m;
+	int fd;
+
+	pagesize = getpagesize();
+	assert(len % pagesize == 0);
+
+	m = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (m == MAP_FAILED)
+		return (NULL);
+	if (mlock(m, len) == -1) {
+		munmap(m, len);
+		return (NULL);
+	}
+
+	fd = open("/proc/self/pagemap", O_RDONLY);
+	if (fd == -1) {
+		munmap(m, len);
+		return (NULL);
+	}
+
+	for (i = 0; i < len / pagesize; i++) {
+		rv = pread(fd, &entry, sizeof entry,
+		    ((uintptr_t)m / pagesize + i) * sizeof entry);
+		/*
+		 * Bit 63 is set for present pages, and bits 0-54
+		 * hold the frame number, which reads as zero for
+		 * unprivileged processes.
+		 */
+		if (rv != sizeof entry || (entry & (1ull << 63)) == 0 ||
+		    (entry & ((1ull << 55) - 1)) == 0) {
+			close(fd);
+			munmap(m, len);
+			return (NULL);
+		}
+		bus[i] = (entry & ((1ull << 55) - 1)) * pagesize;
+	}
+	close(fd);
+
+	return (m);
+}
+
+void
+host_dma_free(void *m, size_t len)
+{
+	munmap(m, len);
+}
+
+static const char *
+host_sysfs_root(void)
+{
+	const char *root;
+
+	root = getenv("BSDOCT_SYSFS_ROOT");
+	if (root == NULL || *root == '\0')
+		return (HOST_SYSFS_ROOT_DEFAULT);
+	return (root);
+}
+
+static bool
+host_sysfs_read_hex(const struct host_pci_dev *hpd, const char *name, uint64_t *valp)
+{
+	char path[PATH_MAX];
+	bool ok;
+	FILE *f;
+
+	host_sysfs_path(path, sizeof path, hpd, name);
+	f = fopen(path, "r");
+	if (f == NULL)
+		return (false);
+	ok = fscanf(f, "%" SCNx64, valp) == 1;
+	fclose(f);
+	return (ok);
+}
+
+static void
+host_sysfs_path(char *path, size_t len, const struct host_pci_dev *hpd, const char *name)
+{
+	snprintf(path, len, "%s/%s/%04x:%02x:%02x.%x/%s", host_sysfs_root(), HOST_SYSFS_DEVICES,
+	    hpd->hpd_domain, hpd->hpd_bus, hpd->hpd_slot, hpd->hpd_function, name);
+}
+
+static int
+host_pci_dev_compare(const void *a, const void *b)
+{
+	const struct host_pci_dev *x, *y;
+
+	x = a;
+	y = b;
+
+	if (x->hpd_domain != y->hpd_domain)
+		return (x->hpd_domain < y->hpd_domain ? -1 : 1);
+	if (x->hpd_bus != y->hpd_bus)
+		return (x->hpd_bus < y->hpd_bus ? -1 : 1);
+	if (x->hpd_slot != y->hpd_slot)
+		return (x->hpd_slot < y->hpd_slot ? -1 : 1);
+	if (x->hpd_function != y->hpd_function)
+		return (x->hpd_function < y->hpd_function ? -1 : 1);
+	return (0);
+}
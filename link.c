@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <cvmx.h>
+#include <cvmx-lmcx-defs.h>
+
+#include "host.h"
+#include "link.h"
+#include "target.h"
+#include "timing.h"
+
+/*
+ * Configuration space offsets and fields, per the PCI and PCI
+ * Express base specifications.
+ */
+#define	LINK_CONFIG_SIZE	(256)
+#define	LINK_STATUS		(0x06)
+#define	LINK_STATUS_CAP_LIST	(0x0010)
+#define	LINK_CAP_PTR		(0x34)
+#define	LINK_CAP_ID_EXP		(0x10)
+
+#define	LINK_EXP_DEVCAP		(0x04)
+#define	LINK_EXP_DEVCTL		(0x08)
+#define	LINK_EXP_LINKCAP	(0x0c)
+#define	LINK_EXP_LINKSTA	(0x12)
+#define	LINK_EXP_SIZE		(0x14)	/* As far as we read.  */
+
+/*
+ * Memory read by the bandwidth probe, from the bottom of target
+ * memory.
+ */
+#define	LINK_PROBE_ADDR		(0)
+#define	LINK_PROBE_SIZE		(4 * 1024 * 1024)
+
+static uint32_t link_config_read(const uint8_t *, unsigned, unsigned);
+static const char *link_speed_string(unsigned);
+static uint64_t link_bandwidth(unsigned, unsigned);
+
+/*
+ * On FreeBSD each dword of configuration space is an ioctl, so rather
+ * than reading it all, read the status and capability pointer, the
+ * header of each capability until the PCI Express one, and then just
+ * the part of that which we use.
+ */
+void
+target_link_attach(struct target *t)
+{
+	uint8_t exp[LINK_EXP_SIZE], word[4];
+	struct target_link *tl;
+	unsigned cap, guard;
+	uint32_t v;
+
+	tl = &t->t_link;
+	tl->tl_valid = false;
+
+	if (!host_pci_config_read(&t->t_pci, LINK_STATUS & ~3u, word, sizeof word))
+		return;
+	if ((link_config_read(word, LINK_STATUS & 3u, 2) & LINK_STATUS_CAP_LIST) == 0)
+		return;
+	if (!host_pci_config_read(&t->t_pci, LINK_CAP_PTR, word, sizeof word))
+		return;
+
+	cap = link_config_read(word, 0, 1) & ~3u;
+	for (guard = 0; cap != 0 && guard < LINK_CONFIG_SIZE / 4; guard++) {
+		if (cap + LINK_EXP_SIZE > LINK_CONFIG_SIZE)
+			return;
+		if (!host_pci_config_read(&t->t_pci, cap, word, sizeof word))
+			return;
+		if (link_config_read(word, 0, 1) == LINK_CAP_ID_EXP)
+			break;
+		cap = link_config_read(word, 1, 1) & ~3u;
+	}
+	if (cap == 0 || guard == LINK_CONFIG_SIZE / 4)
+		return;
+	if (!host_pci_config_read(&t->t_pci, cap, exp, sizeof exp))
+		return;
+
+	v = link_config_read(exp, LINK_EXP_DEVCAP, 4);
+	tl->tl_max_payload_cap = 128u << (v & 0x7);
+	v = link_config_read(exp, LINK_EXP_DEVCTL, 2);
+	tl->tl_max_payload = 128u << ((v >> 5) & 0x7);
+	tl->tl_max_read = 128u << ((v >> 12) & 0x7);
+	v = link_config_read(exp, LINK_EXP_LINKCAP, 4);
+	tl->tl_max_speed = v & 0xf;
+	tl->tl_max_width = (v >> 4) & 0x3f;
+	v = link_config_read(exp, LINK_EXP_LINKSTA, 2);
+	tl->tl_speed = v & 0xf;
+	tl->tl_width = (v >> 4) & 0x3f;
+	tl->tl_valid = true;
+
+	if (tl->tl_speed < tl->tl_max_speed || tl->tl_width < tl->tl_max_width)
+		fprintf(stderr, "target%u: PCIe link degraded: x%u at %s, capable of x%u at %s\n", t->t_unit,
+		    tl->tl_width, link_speed_string(tl->tl_speed),
+		    tl->tl_max_width, link_speed_string(tl->tl_max_speed));
+}
+
+void
+target_link_show(const struct target *t)
+{
+	const struct target_link *tl;
+
+	tl = &t->t_link;
+	if (!tl->tl_valid) {
+		printf("target%u: PCIe link state not available\n", t->t_unit);
+		return;
+	}
+
+	printf("target%u: PCIe link x%u at %s (capable of x%u at %s)%s\n", t->t_unit,
+	    tl->tl_width, link_speed_string(tl->tl_speed),
+	    tl->tl_max_width, link_speed_string(tl->tl_max_speed),
+	    tl->tl_speed < tl->tl_max_speed || tl->tl_width < tl->tl_max_width ? " degraded" : "");
+	printf("target%u: PCIe max payload %u bytes (capable of %u), max read request %u bytes\n", t->t_unit,
+	    tl->tl_max_payload, tl->tl_max_payload_cap, tl->tl_max_read);
+}
+
+uint64_t
+target_link_rate(const struct target *t)
+{
+	if (!t->t_link.tl_valid)
+		return (0);
+	return (link_bandwidth(t->t_link.tl_speed, t->t_link.tl_width));
+}
+
+void
+target_link_probe(struct target *t)
+{
+	cvmx_lmcx_reset_ctl_t lrc;
+	uint64_t bandwidth, start, us;
+	uint8_t *buf;
+
+	lrc.u64 = target_read_csr(t, t->t_csrs.tc_lmc_reset_ctl);
+	if (!lrc.s.ddr3rst) {
+		printf("target%u: memory not available for bandwidth probe\n", t->t_unit);
+		return;
+	}
+
+	buf = malloc(LINK_PROBE_SIZE);
+	if (buf == NULL)
+		err(1, "malloc");
+
+	start = timing_now();
+	target_mem_read(t, LINK_PROBE_ADDR, buf, LINK_PROBE_SIZE);
+	us = timing_now() - start;
+	free(buf);
+	if (us == 0)
+		us = 1;
+
+	bandwidth = (uint64_t)LINK_PROBE_SIZE * 1000000 / us;
+	printf("target%u: memory read %ju MB/s", t->t_unit, (uintmax_t)(bandwidth / 1000000));
+	if (t->t_link.tl_valid && link_bandwidth(t->t_link.tl_speed, t->t_link.tl_width) != 0)
+		printf(", %ju%% of link", (uintmax_t)(bandwidth * 100 / link_bandwidth(t->t_link.tl_speed, t->t_link.tl_width)));
+	printf("\n");
+}
+
+/*
+ * Configuration space is little-endian.
+ */
+static uint32_t
+link_config_read(const uint8_t *config, unsigned reg, unsigned width)
+{
+	uint32_t v;
+	unsigned i;
+
+	v = 0;
+	for (i = 0; i < width; i++)
+		v |= (uint32_t)config[reg + i] << (8 * i);
+	return (v);
+}
+
+static const char *
+link_speed_string(unsigned speed)
+{
+	switch (speed) {
+	case 1:
+		return ("2.5 GT/s");
+	case 2:
+		return ("5 GT/s");
+	case 3:
+		return ("8 GT/s");
+	case 4:
+		return ("16 GT/s");
+	case 5:
+		return ("32 GT/s");
+	default:
+		return ("unknown speed");
+	}
+}
+
+/*
+ * The data rate of a link in bytes per second, after line encoding
+ * but before packet overheads.
+ */
+static uint64_t
+link_bandwidth(unsigned speed, unsigned width)
+{
+	uint64_t lane;
+
+	switch (speed) {
+	case 1:
+		lane = 250000000;		/* 8b/10b */
+		break;
+	case 2:
+		lane = 500000000;		/* 8b/10b */
+		break;
+	case 3:
+		lane = 984615384;		/* 128b/130b */
+		break;
+	case 4:
+		lane = 1969230769;
+		break;
+	case 5:
+		lane = 3938461538u;
+		break;
+	default:
+		return (0);
+	}
+	return (lane * width);
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <paths.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "host.h"
+#include "lock.h"
+#include "target.h"
+
+/*
+ * Each target has a lock file, named for its PCI address, in which
+ * we take advisory byte-range locks with fcntl, one byte for each
+ * range.  Locks are only held for the duration of a transaction or
+ * batch of them, so that concurrent processes interleave rather
+ * than excluding one another.  The directory may be overridden
+ * with BSDOCT_LOCK_DIR.
+ *
+ * The first eight bytes of the file hold the page our BAR1 index
+ * entry was last pointed at, so that a process need not rewrite the
+ * entry unless another process has moved it.
+ */
+#define	TARGET_LOCK_DIR_DEFAULT	_PATH_VARRUN
+#define	TARGET_LOCK_BASE	(64)	/* Offset of the first lock byte.  */
+
+static void target_lock_op(const struct target *, enum target_lock_range, short);
+
+void
+target_lock_open(struct target *t)
+{
+	char path[PATH_MAX];
+	const char *dir;
+
+	dir = getenv("BSDOCT_LOCK_DIR");
+	if (dir == NULL || *dir == '\0')
+		dir = TARGET_LOCK_DIR_DEFAULT;
+
+	snprintf(path, sizeof path, "%s/bsdoct.%04x:%02x:%02x.%x.lock", dir,
+	    t->t_pci.hpd_domain, t->t_pci.hpd_bus, t->t_pci.hpd_slot, t->t_pci.hpd_function);
+
+	t->t_lock_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (t->t_lock_fd == -1)
+		warn("target%u: not locking against other processes: %s", t->t_unit, path);
+}
+
+void
+target_lock(const struct target *t, enum target_lock_range r)
+{
+	target_lock_op(t, r, F_WRLCK);
+}
+
+void
+target_unlock(const struct target *t, enum target_lock_range r)
+{
+	target_lock_op(t, r, F_UNLCK);
+}
+
+bool
+target_lock_bar1_page(const struct target *t, uint64_t *pagep)
+{
+	uint64_t page;
+
+	if (t->t_lock_fd == -1)
+		return (false);
+	if (pread(t->t_lock_fd, &page, sizeof page, 0) != sizeof page)
+		return (false);
+	*pagep = page;
+	return (true);
+}
+
+void
+target_lock_set_bar1_page(const struct target *t, uint64_t page)
+{
+	if (t->t_lock_fd == -1)
+		return;
+	if (pwrite(t->t_lock_fd, &page, sizeof page, 0) != sizeof page)
+		err(1, "target%u: pwrite lock file", t->t_unit);
+}
+
+static void
+target_lock_op(const struct target *t, enum target_lock_range r, short type)
+{
+	struct flock fl;
+
+	if (t->t_lock_fd == -1)
+		return;
+
+	fl.l_type = type;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = TARGET_LOCK_BASE + r;
+	fl.l_len = 1;
+	fl.l_pid = 0;
+	while (fcntl(t->t_lock_fd, F_SETLKW, &fl) == -1) {
+		if (errno != EINTR)
+			err(1, "target%u: fcntl lock", t->t_unit);
+	}
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	LOCK_H
+#define	LOCK_H
+
+struct target;
+
+/*
+ * Shared state on a target which a transaction must not have
+ * changed underneath it by another process.  Each is a separate
+ * byte-range lock in the target's lock file, so that, for instance,
+ * a CSR read in one process need not wait for a CSR write in
+ * another.  Where more than one is held, they are taken in this
+ * order.
+ */
+enum target_lock_range {
+	TARGET_LOCK_DMA,	/* Our DPI queue and the DMA scratch area.  */
+	TARGET_LOCK_MBOX,	/* The host side of the mailbox rings.  */
+	TARGET_LOCK_CORES,	/* CIU_PP_RST.  */
+	TARGET_LOCK_TWSI,	/* TWSI controllers.  */
+	TARGET_LOCK_FUSE,	/* MIO_FUS_RCMD.  */
+	TARGET_LOCK_BAR1,	/* Our BAR1 index entry.  */
+	TARGET_LOCK_WIN_RD,	/* SLI read window.  */
+	TARGET_LOCK_WIN_WR,	/* SLI write window.  */
+};
+
+void target_lock_open(struct target *);
+void target_lock(const struct target *, enum target_lock_range);
+void target_unlock(const struct target *, enum target_lock_range);
+
+/*
+ * The page our BAR1 index entry maps, as last set by any process.
+ * Only meaningful with TARGET_LOCK_BAR1 held.
+ */
+bool target_lock_bar1_page(const struct target *, uint64_t *);
+void target_lock_set_bar1_page(const struct target *, uint64_t);
+
+#endif /* !LOCK_H */
@@ -0,0 +1,374 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <err.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <cvmx.h>
+
+#include "host.h"
+#include "lock.h"
+#include "mbox.h"
+#include "target.h"
+#include "timing.h"
+
+/*
+ * Requests and responses are copied through a buffer of up to
+ * TARGET_MBOX_BATCH slots, so that each batch crosses BAR1 in at
+ * most two bulk transfers, one on either side of the ring's end.
+ */
+#define	TARGET_MBOX_BATCH	(64)
+#define	TARGET_MBOX_TIMEOUT	(1000000)	/* Microseconds.  */
+
+/*
+ * While waiting for responses, poll without sleeping for a while,
+ * since a target which is polling its ring answers in a few
+ * microseconds, and then back off exponentially so that a slow
+ * request does not keep a host core spinning.
+ */
+#define	TARGET_MBOX_SPINS	(100)
+#define	TARGET_MBOX_SLEEP_MIN	(10)		/* Microseconds.  */
+#define	TARGET_MBOX_SLEEP_MAX	(1000)		/* Microseconds.  */
+
+/*
+ * The layout of the ring header and slots in target memory, as
+ * described in mbox.h.
+ */
+struct mbox_header {
+	uint32_t mh_magic;
+	uint16_t mh_version;
+	uint16_t mh_entries;
+	uint32_t mh_req_prod;
+	uint32_t mh_req_cons;
+	uint32_t mh_rsp_prod;
+	uint32_t mh_rsp_cons;
+	uint32_t mh_flags;
+	uint32_t mh_reserved;
+	uint64_t mh_doorbell_csr;
+	uint64_t mh_doorbell_data;
+	uint64_t mh_req_ring;
+	uint64_t mh_rsp_ring;
+};
+
+struct mbox_slot {
+	uint32_t ms_tag;
+	uint16_t ms_op;
+	uint16_t ms_len;
+	uint8_t ms_data[MBOX_DATA_MAX];
+};
+
+struct target_mbox {
+	bool tmb_available;
+
+	uint64_t tmb_header;
+	uint32_t tmb_entries;
+	uint64_t tmb_doorbell_csr;
+	uint64_t tmb_doorbell_data;
+	uint64_t tmb_req_ring;
+	uint64_t tmb_rsp_ring;
+
+	/*
+	 * The host is the only writer of these indexes, so while
+	 * we hold the mailbox lock we keep our own copies rather
+	 * than reading them back.
+	 */
+	uint32_t tmb_req_prod;
+	uint32_t tmb_rsp_cons;
+};
+
+static struct target_mbox *target_mbox_attach(struct target *);
+static void target_mbox_sync(struct target *, struct target_mbox *);
+static void target_mbox_put(struct target *, struct target_mbox *, const struct mbox_msg *, unsigned);
+static void target_mbox_get(struct target *, struct target_mbox *, struct mbox_msg *, unsigned);
+static uint32_t target_mbox_wait(struct target *, struct target_mbox *, uint32_t, size_t);
+static uint32_t target_mbox_read4(struct target *, struct target_mbox *, size_t);
+static void target_mbox_write4(struct target *, struct target_mbox *, size_t, uint32_t);
+
+bool
+target_mbox_call(struct target *t, const struct mbox_msg *req, struct mbox_msg *rsp, unsigned n)
+{
+	struct target_mbox *tmb;
+	unsigned count, received, sent;
+	uint32_t cons, flags, prod;
+
+	target_lock(t, TARGET_LOCK_MBOX);
+	tmb = target_mbox_attach(t);
+	if (tmb == NULL) {
+		target_unlock(t, TARGET_LOCK_MBOX);
+		return (false);
+	}
+	target_mbox_sync(t, tmb);
+
+	sent = 0;
+	received = 0;
+	while (received < n) {
+		/*
+		 * Queue as many of the remaining requests as there
+		 * is room for, publish them all at once, and ring
+		 * the doorbell only if the target is waiting for it.
+		 */
+		if (sent < n) {
+			cons = target_mbox_read4(t, tmb, offsetof(struct mbox_header, mh_req_cons));
+			count = tmb->tmb_entries - (tmb->tmb_req_prod - cons);
+			if (count > n - sent)
+				count = n - sent;
+			if (count != 0) {
+				target_mbox_put(t, tmb, req + sent, count);
+				sent += count;
+
+				target_mbox_write4(t, tmb, offsetof(struct mbox_header, mh_req_prod), tmb->tmb_req_prod);
+				flags = target_mbox_read4(t, tmb, offsetof(struct mbox_header, mh_flags));
+				if ((flags & MBOX_F_DOORBELL) != 0 &&
+				    tmb->tmb_doorbell_csr != 0)
+					target_write_csr(t, tmb->tmb_doorbell_csr, tmb->tmb_doorbell_data);
+			}
+		}
+
+		prod = target_mbox_wait(t, tmb, tmb->tmb_rsp_cons, offsetof(struct mbox_header, mh_rsp_prod));
+		count = prod - tmb->tmb_rsp_cons;
+		if (count > n - received)
+			count = n - received;
+		target_mbox_get(t, tmb, rsp + received, count);
+		received += count;
+
+		target_mbox_write4(t, tmb, offsetof(struct mbox_header, mh_rsp_cons), tmb->tmb_rsp_cons);
+	}
+	target_unlock(t, TARGET_LOCK_MBOX);
+
+	return (true);
+}
+
+/*
+ * Find and check the target's mailbox the first time it is used,
+ * returning NULL if it has none.
+ */
+static struct target_mbox *
+target_mbox_attach(struct target *t)
+{
+	struct target_mbox *tmb;
+	struct mbox_header mh;
+	uint64_t header;
+
+	if (t->t_mbox != NULL)
+		return (t->t_mbox->tmb_available ? t->t_mbox : NULL);
+
+	tmb = calloc(1, sizeof *tmb);
+	if (tmb == NULL)
+		err(1, "calloc");
+	t->t_mbox = tmb;
+
+	if (!t->t_pci_bar[1].tb_enabled) {
+		fprintf(stderr, "target%u: BAR1 not available for mailbox\n", t->t_unit);
+		return (NULL);
+	}
+
+	header = target_read_sli(t, t->t_csrs.tc_sli_scratch_2);
+	if (header == 0) {
+		fprintf(stderr, "target%u: no mailbox published\n", t->t_unit);
+		return (NULL);
+	}
+	if (header % 8 != 0) {
+		fprintf(stderr, "target%u: misaligned mailbox header at %#jx\n", t->t_unit, (uintmax_t)header);
+		return (NULL);
+	}
+
+	target_mem_read(t, header, &mh, sizeof mh);
+	if (be32toh(mh.mh_magic) != MBOX_MAGIC) {
+		fprintf(stderr, "target%u: bad mailbox magic at %#jx\n", t->t_unit, (uintmax_t)header);
+		return (NULL);
+	}
+	if (be16toh(mh.mh_version) != MBOX_VERSION) {
+		fprintf(stderr, "target%u: unsupported mailbox version %u\n", t->t_unit, be16toh(mh.mh_version));
+		return (NULL);
+	}
+
+	tmb->tmb_header = header;
+	tmb->tmb_entries = be16toh(mh.mh_entries);
+	if (tmb->tmb_entries == 0 ||
+	    (tmb->tmb_entries & (tmb->tmb_entries - 1)) != 0) {
+		fprintf(stderr, "target%u: bad mailbox ring size %u\n", t->t_unit, tmb->tmb_entries);
+		return (NULL);
+	}
+	tmb->tmb_doorbell_csr = be64toh(mh.mh_doorbell_csr);
+	tmb->tmb_doorbell_data = be64toh(mh.mh_doorbell_data);
+	tmb->tmb_req_ring = be64toh(mh.mh_req_ring);
+	tmb->tmb_rsp_ring = be64toh(mh.mh_rsp_ring);
+
+	tmb->tmb_available = true;
+	return (tmb);
+}
+
+/*
+ * Load the host's indexes, which other processes may have moved
+ * since we last held the mailbox lock.  Requests left outstanding
+ * by a caller which gave up are allowed to complete, and their
+ * responses are discarded, so that the responses we see are to our
+ * requests.
+ */
+static void
+target_mbox_sync(struct target *t, struct target_mbox *tmb)
+{
+	uint32_t prod;
+
+	tmb->tmb_req_prod = target_mbox_read4(t, tmb, offsetof(struct mbox_header, mh_req_prod));
+	prod = target_mbox_read4(t, tmb, offsetof(struct mbox_header, mh_rsp_prod));
+	tmb->tmb_rsp_cons = target_mbox_read4(t, tmb, offsetof(struct mbox_header, mh_rsp_cons));
+
+	/*
+	 * Every request produces a response, so once the response
+	 * producer index has caught up with the request producer
+	 * index, nothing is outstanding.
+	 */
+	while (prod != tmb->tmb_req_prod) {
+		if (tmb->tmb_req_prod - prod > tmb->tmb_entries)
+			errx(1, "target%u: mailbox indexes inconsistent.", t->t_unit);
+		prod = target_mbox_wait(t, tmb, prod, offsetof(struct mbox_header, mh_rsp_prod));
+	}
+	if (tmb->tmb_rsp_cons != prod) {
+		tmb->tmb_rsp_cons = prod;
+		target_mbox_write4(t, tmb, offsetof(struct mbox_header, mh_rsp_cons), tmb->tmb_rsp_cons);
+	}
+}
+
+static void
+target_mbox_put(struct target *t, struct target_mbox *tmb, const struct mbox_msg *req, unsigned n)
+{
+	struct mbox_slot slots[TARGET_MBOX_BATCH];
+	unsigned count, first, i;
+
+	while (n != 0) {
+		count = n > TARGET_MBOX_BATCH ? TARGET_MBOX_BATCH : n;
+		for (i = 0; i < count; i++) {
+			if (req[i].mm_len > MBOX_DATA_MAX)
+				errx(1, "mailbox payload too long.");
+			memset(&slots[i], 0, sizeof slots[i]);
+			slots[i].ms_tag = htobe32(req[i].mm_tag);
+			slots[i].ms_op = htobe16(req[i].mm_op);
+			slots[i].ms_len = htobe16(req[i].mm_len);
+			memcpy(slots[i].ms_data, req[i].mm_data, req[i].mm_len);
+		}
+
+		first = tmb->tmb_req_prod & (tmb->tmb_entries - 1);
+		i = tmb->tmb_entries - first;
+		if (i > count)
+			i = count;
+		target_mem_write(t, tmb->tmb_req_ring + (uint64_t)first * MBOX_SLOT_SIZE, slots, i * MBOX_SLOT_SIZE);
+		if (i != count)
+			target_mem_write(t, tmb->tmb_req_ring, &slots[i], (count - i) * MBOX_SLOT_SIZE);
+
+		tmb->tmb_req_prod += count;
+		req += count;
+		n -= count;
+	}
+}
+
+static void
+target_mbox_get(struct target *t, struct target_mbox *tmb, struct mbox_msg *rsp, unsigned n)
+{
+	struct mbox_slot slots[TARGET_MBOX_BATCH];
+	unsigned count, first, i;
+
+	while (n != 0) {
+		count = n > TARGET_MBOX_BATCH ? TARGET_MBOX_BATCH : n;
+
+		first = tmb->tmb_rsp_cons & (tmb->tmb_entries - 1);
+		i = tmb->tmb_entries - first;
+		if (i > count)
+			i = count;
+		target_mem_read(t, tmb->tmb_rsp_ring + (uint64_t)first * MBOX_SLOT_SIZE, slots, i * MBOX_SLOT_SIZE);
+		if (i != count)
+			target_mem_read(t, tmb->tmb_rsp_ring, &slots[i], (count - i) * MBOX_SLOT_SIZE);
+
+		for (i = 0; i < count; i++) {
+			rsp[i].mm_tag = be32toh(slots[i].ms_tag);
+			rsp[i].mm_op = be16toh(slots[i].ms_op);
+			rsp[i].mm_len = be16toh(slots[i].ms_len);
+			if (rsp[i].mm_len > MBOX_DATA_MAX)
+				errx(1, "target%u: mailbox response payload too long.", t->t_unit);
+			memcpy(rsp[i].mm_data, slots[i].ms_data, rsp[i].mm_len);
+		}
+
+		tmb->tmb_rsp_cons += count;
+		rsp += count;
+		n -= count;
+	}
+}
+
+/*
+ * Wait for the index at the given header offset to move away from
+ * the value we last saw, and return its new value.
+ */
+static uint32_t
+target_mbox_wait(struct target *t, struct target_mbox *tmb, uint32_t last, size_t offset)
+{
+	struct timespec ts;
+	uint64_t deadline, delay;
+	uint32_t v;
+	unsigned i;
+
+	deadline = 0;
+	delay = TARGET_MBOX_SLEEP_MIN;
+	for (i = 0;; i++) {
+		v = target_mbox_read4(t, tmb, offset);
+		if (v != last)
+			return (v);
+		if (i < TARGET_MBOX_SPINS)
+			continue;
+
+		if (deadline == 0)
+			deadline = timing_now() + TARGET_MBOX_TIMEOUT;
+		else if (timing_now() > deadline)
+			errx(1, "target%u: mailbox timed out.", t->t_unit);
+
+		ts.tv_sec = 0;
+		ts.tv_nsec = delay * 1000;
+		nanosleep(&ts, NULL);
+		if (delay < TARGET_MBOX_SLEEP_MAX)
+			delay *= 2;
+	}
+}
+
+/*
+ * Header fields are shared with the target, so each is read or
+ * written in a single access.
+ */
+static uint32_t
+target_mbox_read4(struct target *t, struct target_mbox *tmb, size_t offset)
+{
+	return (target_mem_read4(t, tmb->tmb_header + offset));
+}
+
+static void
+target_mbox_write4(struct target *t, struct target_mbox *tmb, size_t offset, uint32_t v)
+{
+	target_mem_write4(t, tmb->tmb_header + offset, v);
+}
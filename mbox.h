@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	MBOX_H
+#define	MBOX_H
+
+struct target;
+
+/*
+ * A request/response channel to software on the target, made of two
+ * rings of fixed-size messages in target memory which we reach
+ * through BAR1.  The target publishes the address of its ring header
+ * in SLI_SCRATCH_2.
+ *
+ * A batch of requests is published with a single write of the
+ * request producer index, and the doorbell, a CSR write described
+ * by the target, is only rung if the target has set MBOX_F_DOORBELL
+ * to say that it has stopped polling.  A target must set the flag
+ * before it checks the producer index for the last time, and the
+ * host reads the flag only after it has written the index, so one
+ * of the two always sees the other's update.
+ *
+ * All fields in target memory are big-endian.  The ring header is
+ * 8-byte aligned, and each index is read and written by the host as
+ * a single 32-bit access, so it is never seen half-updated:
+ *
+ *	offset	size	field
+ *	0	4	magic (MBOX_MAGIC)
+ *	4	2	version (MBOX_VERSION)
+ *	6	2	slots in each ring, a power of two
+ *	8	4	request producer index, written by the host
+ *	12	4	request consumer index, written by the target
+ *	16	4	response producer index, written by the target
+ *	20	4	response consumer index, written by the host
+ *	24	4	flags, written by the target (MBOX_F_*)
+ *	28	4	reserved
+ *	32	8	doorbell CSR address, or 0 for none
+ *	40	8	doorbell CSR value
+ *	48	8	address of the request ring
+ *	56	8	address of the response ring
+ *
+ * Indexes run freely and are reduced modulo the ring size.  The
+ * target produces exactly one response for each request it consumes.
+ *
+ * Each slot holds a tag, chosen by the host and copied into the
+ * response, an opcode (or, in a response, a status), a payload
+ * length, and up to MBOX_DATA_MAX bytes of payload.
+ */
+#define	MBOX_MAGIC		(0x424f4354)	/* "BOCT" */
+#define	MBOX_VERSION		(1)
+
+#define	MBOX_F_DOORBELL		(0x00000001)	/* Target is waiting for a doorbell.  */
+
+#define	MBOX_SLOT_SIZE		(64)
+#define	MBOX_DATA_MAX		(MBOX_SLOT_SIZE - 8)
+
+struct mbox_msg {
+	uint32_t mm_tag;
+	uint16_t mm_op;
+	uint16_t mm_len;
+	uint8_t mm_data[MBOX_DATA_MAX];
+};
+
+/*
+ * Send a batch of requests and wait for their responses, which are
+ * returned in the order the target produces them.  Returns false,
+ * having sent nothing, if the target has no mailbox.
+ */
+bool target_mbox_call(struct target *, const struct mbox_msg *, struct mbox_msg *, unsigned);
+
+#endif /* !MBOX_H */
@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "mmio.h"
+
+/*
+ * Width of the accesses used for the body of a bulk copy.  With SSE2,
+ * copies to the device use non-temporal stores, which are combined
+ * into full bursts when the destination is mapped write-combining.
+ */
+#if defined(__SSE2__)
+#define	MMIO_COPY_WIDTH	(16)
+#elif MMIO_NATIVE64
+#define	MMIO_COPY_WIDTH	(8)
+#else
+#define	MMIO_COPY_WIDTH	(4)
+#endif
+
+static size_t mmio_part_width(uintptr_t, size_t);
+static void mmio_copyin_part(uint8_t *, uintptr_t, size_t);
+static void mmio_copyout_part(uintptr_t, const uint8_t *, size_t);
+
+void
+mmio_copyin(void *dst, uintptr_t src, size_t len)
+{
+	uint8_t *d;
+	size_t n;
+
+	d = dst;
+
+	n = (MMIO_COPY_WIDTH - src % MMIO_COPY_WIDTH) % MMIO_COPY_WIDTH;
+	if (n > len)
+		n = len;
+	mmio_copyin_part(d, src, n);
+	d += n;
+	src += n;
+	len -= n;
+
+	while (len >= MMIO_COPY_WIDTH) {
+#if defined(__SSE2__)
+		__m128i v;
+
+		v = _mm_load_si128((const __m128i *)src);
+		_mm_storeu_si128((__m128i *)d, v);
+#elif MMIO_NATIVE64
+		uint64_t v;
+
+		v = *(volatile uint64_t *)src;
+		memcpy(d, &v, sizeof v);
+#else
+		uint32_t v;
+
+		v = *(volatile uint32_t *)src;
+		memcpy(d, &v, sizeof v);
+#endif
+		d += MMIO_COPY_WIDTH;
+		src += MMIO_COPY_WIDTH;
+		len -= MMIO_COPY_WIDTH;
+	}
+
+	mmio_copyin_part(d, src, len);
+}
+
+void
+mmio_copyout(uintptr_t dst, const void *src, size_t len)
+{
+	const uint8_t *s;
+	size_t n;
+
+	s = src;
+
+	n = (MMIO_COPY_WIDTH - dst % MMIO_COPY_WIDTH) % MMIO_COPY_WIDTH;
+	if (n > len)
+		n = len;
+	mmio_copyout_part(dst, s, n);
+	s += n;
+	dst += n;
+	len -= n;
+
+	while (len >= MMIO_COPY_WIDTH) {
+#if defined(__SSE2__)
+		__m128i v;
+
+		v = _mm_loadu_si128((const __m128i *)s);
+		_mm_stream_si128((__m128i *)dst, v);
+#elif MMIO_NATIVE64
+		uint64_t v;
+
+		memcpy(&v, s, sizeof v);
+		*(volatile uint64_t *)dst = v;
+#else
+		uint32_t v;
+
+		memcpy(&v, s, sizeof v);
+		*(volatile uint32_t *)dst = v;
+#endif
+		s += MMIO_COPY_WIDTH;
+		dst += MMIO_COPY_WIDTH;
+		len -= MMIO_COPY_WIDTH;
+	}
+
+	mmio_copyout_part(dst, s, len);
+
+#if defined(__SSE2__)
+	/*
+	 * Drain non-temporal stores before anything which
+	 * might signal the target that the data is present.
+	 */
+	_mm_sfence();
+#endif
+}
+
+/*
+ * The unaligned head and the tail of a copy, which are shorter than
+ * MMIO_COPY_WIDTH, are moved with the widest naturally-aligned
+ * accesses that fit, so that a word within them is still a single
+ * bus transaction, and cannot be torn, rather than a byte at a time.
+ */
+static size_t
+mmio_part_width(uintptr_t va, size_t len)
+{
+#if MMIO_NATIVE64
+	if (va % 8 == 0 && len >= 8)
+		return (8);
+#endif
+	if (va % 4 == 0 && len >= 4)
+		return (4);
+	if (va % 2 == 0 && len >= 2)
+		return (2);
+	return (1);
+}
+
+static void
+mmio_copyin_part(uint8_t *d, uintptr_t src, size_t len)
+{
+#if MMIO_NATIVE64
+	uint64_t v8;
+#endif
+	uint32_t v4;
+	uint16_t v2;
+	size_t w;
+
+	while (len != 0) {
+		w = mmio_part_width(src, len);
+		switch (w) {
+#if MMIO_NATIVE64
+		case 8:
+			v8 = *(volatile uint64_t *)src;
+			memcpy(d, &v8, w);
+			break;
+#endif
+		case 4:
+			v4 = *(volatile uint32_t *)src;
+			memcpy(d, &v4, w);
+			break;
+		case 2:
+			v2 = *(volatile uint16_t *)src;
+			memcpy(d, &v2, w);
+			break;
+		default:
+			*d = *(volatile uint8_t *)src;
+			break;
+		}
+		d += w;
+		src += w;
+		len -= w;
+	}
+}
+
+static void
+mmio_copyout_part(uintptr_t dst, const uint8_t *s, size_t len)
+{
+#if MMIO_NATIVE64
+	uint64_t v8;
+#endif
+	uint32_t v4;
+	uint16_t v2;
+	size_t w;
+
+	while (len != 0) {
+		w = mmio_part_width(dst, len);
+		switch (w) {
+#if MMIO_NATIVE64
+		case 8:
+			memcpy(&v8, s, w);
+			*(volatile uint64_t *)dst = v8;
+			break;
+#endif
+		case 4:
+			memcpy(&v4, s, w);
+			*(volatile uint32_t *)dst = v4;
+			break;
+		case 2:
+			memcpy(&v2, s, w);
+			*(volatile uint16_t *)dst = v2;
+			break;
+		default:
+			*(volatile uint8_t *)dst = *s;
+			break;
+		}
+		s += w;
+		dst += w;
+		len -= w;
+	}
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef	MMIO_H
+#define	MMIO_H
+
+/*
+ * MMIO_NATIVE64 is set on hosts which issue a naturally-aligned 64-bit
+ * load or store as a single bus transaction.  Elsewhere 64-bit device
+ * registers must be accessed as two 32-bit halves.
+ */
+#if defined(__amd64__) || defined(__x86_64__) || defined(__aarch64__) || \
+    defined(__powerpc64__) || (defined(__mips__) && defined(__LP64__))
+#define	MMIO_NATIVE64	(1)
+#else
+#define	MMIO_NATIVE64	(0)
+#endif
+
+/*
+ * Little-endian register access to mapped device memory.
+ */
+static inline uint32_t
+mmio_read4(uintptr_t va)
+{
+	return (le32toh(*(volatile uint32_t *)va));
+}
+
+static inline void
+mmio_write4(uintptr_t va, uint32_t data)
+{
+	*(volatile uint32_t *)va = htole32(data);
+}
+
+#if MMIO_NATIVE64
+static inline uint64_t
+mmio_read8(uintptr_t va)
+{
+	return (le64toh(*(volatile uint64_t *)va));
+}
+
+static inline void
+mmio_write8(uintptr_t va, uint64_t data)
+{
+	*(volatile uint64_t *)va = htole64(data);
+}
+#endif
+
+/*
+ * Big-endian access to mapped target memory, which BAR1 presents
+ * without swapping, each a single bus transaction.
+ */
+static inline uint32_t
+mmio_read4_be(uintptr_t va)
+{
+	return (be32toh(*(volatile uint32_t *)va));
+}
+
+static inline void
+mmio_write4_be(uintptr_t va, uint32_t data)
+{
+	*(volatile uint32_t *)va = htobe32(data);
+}
+
+#if MMIO_NATIVE64
+static inline uint64_t
+mmio_read8_be(uintptr_t va)
+{
+	return (be64toh(*(volatile uint64_t *)va));
+}
+
+static inline void
+mmio_write8_be(uintptr_t va, uint64_t data)
+{
+	*(volatile uint64_t *)va = htobe64(data);
+}
+#endif
+
+/*
+ * Bulk copies between host memory and mapped device memory, using the
+ * widest accesses this host supports.  Data is copied in byte order,
+ * without swapping.  Any naturally-aligned word of up to the host's
+ * native width is moved in a single access.
+ */
+void mmio_copyin(void *, uintptr_t, size_t);
+void mmio_copyout(uintptr_t, const void *, size_t);
+
+#endif /* !MMIO_H */
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <err.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <cvmx.h>
+
+#include "host.h"
+#include "profile.h"
+#include "target.h"
+#include "timing.h"
+
+#define	PROFILE_COUNTERS_MAX	(64)
+
+/*
+ * The counters sampled for one target, with the values read at the
+ * previous and the current sample.
+ */
+struct profile_state {
+	struct target *ps_target;
+
+	unsigned ps_count;
+	const char *ps_names[PROFILE_COUNTERS_MAX];
+	uint64_t ps_addrs[PROFILE_COUNTERS_MAX];
+	uint64_t ps_prev[PROFILE_COUNTERS_MAX];
+	uint64_t ps_cur[PROFILE_COUNTERS_MAX];
+	uint64_t ps_time;
+};
+
+static const char *profile_lmc_names[][3] = {
+	{ "lmc0.ops", "lmc0.ifb", "lmc0.dclk" },
+	{ "lmc1.ops", "lmc1.ifb", "lmc1.dclk" },
+	{ "lmc2.ops", "lmc2.ifb", "lmc2.dclk" },
+	{ "lmc3.ops", "lmc3.ifb", "lmc3.dclk" },
+};
+
+static const char *profile_l2c_names[][4] = {
+	{ "tad0.pfc0", "tad0.pfc1", "tad0.pfc2", "tad0.pfc3" },
+	{ "tad1.pfc0", "tad1.pfc1", "tad1.pfc2", "tad1.pfc3" },
+	{ "tad2.pfc0", "tad2.pfc1", "tad2.pfc2", "tad2.pfc3" },
+	{ "tad3.pfc0", "tad3.pfc1", "tad3.pfc2", "tad3.pfc3" },
+};
+
+static volatile sig_atomic_t profile_done;
+
+static void profile_setup(struct profile_state *, FILE *);
+static void profile_add(struct profile_state *, const char *, uint64_t);
+static void profile_signal(int);
+
+void
+target_profile_run(struct target **targets, unsigned ntargets, unsigned interval, unsigned samples, FILE *fp)
+{
+	struct profile_state *states, *ps;
+	struct timespec next;
+	uint64_t now, start;
+	unsigned i, j, n;
+
+	states = calloc(ntargets, sizeof *states);
+	if (states == NULL)
+		err(1, "calloc");
+
+	fprintf(fp, "# interval %ums\n", interval);
+	for (i = 0; i < ntargets; i++) {
+		states[i].ps_target = targets[i];
+		profile_setup(&states[i], fp);
+	}
+
+	signal(SIGINT, profile_signal);
+	signal(SIGTERM, profile_signal);
+
+	/*
+	 * Take a baseline sample, then sample at fixed times from
+	 * it, so that time spent reading counters does not make the
+	 * interval drift.
+	 */
+	start = timing_now();
+	for (i = 0; i < ntargets; i++) {
+		ps = &states[i];
+		ps->ps_time = timing_now();
+		target_read_csr_batch(ps->ps_target, ps->ps_addrs, ps->ps_prev, ps->ps_count);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (n = 0; !profile_done && (samples == 0 || n < samples); n++) {
+		next.tv_sec += interval / 1000;
+		next.tv_nsec += (long)(interval % 1000) * 1000000;
+		if (next.tv_nsec >= 1000000000) {
+			next.tv_sec++;
+			next.tv_nsec -= 1000000000;
+		}
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR) {
+			if (profile_done)
+				break;
+		}
+		if (profile_done)
+			break;
+
+		for (i = 0; i < ntargets; i++) {
+			ps = &states[i];
+			now = timing_now();
+			target_read_csr_batch(ps->ps_target, ps->ps_addrs, ps->ps_cur, ps->ps_count);
+
+			fprintf(fp, "%u,%ju,%ju", ps->ps_target->t_unit,
+			    (uintmax_t)(now - start), (uintmax_t)(now - ps->ps_time));
+			for (j = 0; j < ps->ps_count; j++)
+				fprintf(fp, ",%ju", (uintmax_t)(ps->ps_cur[j] - ps->ps_prev[j]));
+			fprintf(fp, "\n");
+
+			memcpy(ps->ps_prev, ps->ps_cur, ps->ps_count * sizeof ps->ps_cur[0]);
+			ps->ps_time = now;
+		}
+		fflush(fp);
+	}
+
+	free(states);
+}
+
+/*
+ * Choose the counters to sample for a target and describe its
+ * columns.  The L2C counters count whatever events software on the
+ * target has selected, so that selection is recorded too.  The CIU
+ * has nothing that counts events, so nothing is taken from it.
+ */
+static void
+profile_setup(struct profile_state *ps, FILE *fp)
+{
+	const struct target_csrs *tc;
+	struct target *t;
+	unsigned i, j;
+
+	t = ps->ps_target;
+	tc = &t->t_csrs;
+
+	for (i = 0; i < tc->tc_lmcs; i++) {
+		profile_add(ps, profile_lmc_names[i][0], tc->tc_lmcx_ops_cnt[i]);
+		profile_add(ps, profile_lmc_names[i][1], tc->tc_lmcx_ifb_cnt[i]);
+		profile_add(ps, profile_lmc_names[i][2], tc->tc_lmcx_dclk_cnt[i]);
+	}
+	for (i = 0; i < tc->tc_l2c_tads; i++) {
+		for (j = 0; j < 4; j++)
+			profile_add(ps, profile_l2c_names[i][j], tc->tc_l2c_tadx_pfc[i][j]);
+	}
+
+	if (tc->tc_l2c_tads != 0)
+		fprintf(fp, "# target%u l2c_tad_prf 0x%016jx\n", t->t_unit, (uintmax_t)target_read_csr(t, tc->tc_l2c_tad_prf));
+	fprintf(fp, "# target%u columns: target,time_us,interval_us", t->t_unit);
+	for (i = 0; i < ps->ps_count; i++)
+		fprintf(fp, ",%s", ps->ps_names[i]);
+	fprintf(fp, "\n");
+}
+
+static void
+profile_add(struct profile_state *ps, const char *name, uint64_t addr)
+{
+	if (ps->ps_count == PROFILE_COUNTERS_MAX)
+		errx(1, "too many profile counters.");
+	ps->ps_names[ps->ps_count] = name;
+	ps->ps_addrs[ps->ps_count] = addr;
+	ps->ps_count++;
+}
+
+static void
+profile_signal(int sig)
+{
+	(void)sig;
+	profile_done = 1;
+}
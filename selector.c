@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "target.h"
+
+#define	TARGET_SELECTOR_WORD_BITS	(64)
+
+static void target_selector_grow(struct target_selector *, unsigned);
+
+void
+target_selector_init(struct target_selector *ts)
+{
+	ts->ts_words = 0;
+	ts->ts_mask = NULL;
+}
+
+void
+target_selector_fini(struct target_selector *ts)
+{
+	free(ts->ts_mask);
+	target_selector_init(ts);
+}
+
+void
+target_selector_copy(struct target_selector *dst, const struct target_selector *src)
+{
+	target_selector_clear(dst);
+	if (src->ts_words == 0)
+		return;
+	target_selector_grow(dst, src->ts_words);
+	memcpy(dst->ts_mask, src->ts_mask, src->ts_words * sizeof *src->ts_mask);
+}
+
+void
+target_selector_clear(struct target_selector *ts)
+{
+	if (ts->ts_words == 0)
+		return;
+	memset(ts->ts_mask, 0, ts->ts_words * sizeof *ts->ts_mask);
+}
+
+void
+target_selector_set(struct target_selector *ts, unsigned n)
+{
+	target_selector_grow(ts, n / TARGET_SELECTOR_WORD_BITS + 1);
+	ts->ts_mask[n / TARGET_SELECTOR_WORD_BITS] |=
+	    1ull << (n % TARGET_SELECTOR_WORD_BITS);
+}
+
+bool
+target_selector_isset(const struct target_selector *ts, unsigned n)
+{
+	if (n / TARGET_SELECTOR_WORD_BITS >= ts->ts_words)
+		return (false);
+	return ((ts->ts_mask[n / TARGET_SELECTOR_WORD_BITS] &
+	    1ull << (n % TARGET_SELECTOR_WORD_BITS)) != 0);
+}
+
+unsigned
+target_selector_count(const struct target_selector *ts)
+{
+	unsigned count, w;
+
+	count = 0;
+	for (w = 0; w < ts->ts_words; w++)
+		count += __builtin_popcountll(ts->ts_mask[w]);
+	return (count);
+}
+
+/*
+ * Return the lowest selected unit at or above n, or TARGET_SELECTOR_END.
+ */
+unsigned
+target_selector_next(const struct target_selector *ts, unsigned n)
+{
+	uint64_t bits;
+	unsigned w;
+
+	w = n / TARGET_SELECTOR_WORD_BITS;
+	if (w >= ts->ts_words)
+		return (TARGET_SELECTOR_END);
+
+	bits = ts->ts_mask[w] & (~0ull << (n % TARGET_SELECTOR_WORD_BITS));
+	for (;;) {
+		if (bits != 0)
+			return (w * TARGET_SELECTOR_WORD_BITS + __builtin_ctzll(bits));
+		if (++w == ts->ts_words)
+			return (TARGET_SELECTOR_END);
+		bits = ts->ts_mask[w];
+	}
+}
+
+/*
+ * Parse a target list of the form 1,3,5-7,9- and add each present
+ * target it names to selected.  A range selects whichever targets
+ * are present within it, and an open-ended range extends to the
+ * last target present.
+ */
+void
+target_selector_parse(struct target_selector *selected, const struct target_selector *all, const char *list)
+{
+	unsigned long first, last;
+	unsigned found, n;
+	const char *p;
+	char *end;
+
+	p = list;
+	for (;;) {
+		if (*p < '0' || *p > '9')
+			errx(1, "invalid target list: %s", list);
+		first = strtoul(p, &end, 10);
+		if (first >= TARGET_SELECTOR_END)
+			errx(1, "invalid target list: %s", list);
+		p = end;
+
+		if (*p != '-') {
+			if (!TARGET_SELECTED(all, first))
+				errx(1, "target%lu not present.", first);
+			TARGET_SELECT(selected, first);
+		} else {
+			p++;
+			if (*p == '\0' || *p == ',') {
+				last = TARGET_SELECTOR_END - 1;
+			} else {
+				if (*p < '0' || *p > '9')
+					errx(1, "invalid target list: %s", list);
+				last = strtoul(p, &end, 10);
+				if (last >= TARGET_SELECTOR_END || last < first)
+					errx(1, "invalid target range in list: %s", list);
+				p = end;
+			}
+
+			found = 0;
+			for (n = target_selector_next(all, first);
+			     n != TARGET_SELECTOR_END && n <= last;
+			     n = target_selector_next(all, n + 1)) {
+				TARGET_SELECT(selected, n);
+				found++;
+			}
+			if (found == 0)
+				errx(1, "no targets present in range %lu-%lu.", first, last);
+		}
+
+		if (*p == '\0')
+			break;
+		if (*p != ',')
+			errx(1, "invalid target list: %s", list);
+		p++;
+	}
+}
+
+static void
+target_selector_grow(struct target_selector *ts, unsigned words)
+{
+	uint64_t *mask;
+
+	if (words <= ts->ts_words)
+		return;
+
+	mask = reallocarray(ts->ts_mask, words, sizeof *mask);
+	if (mask == NULL)
+		err(1, "reallocarray");
+	memset(&mask[ts->ts_words], 0, (words - ts->ts_words) * sizeof *mask);
+
+	ts->ts_mask = mask;
+	ts->ts_words = words;
+}
@@ -24,45 +24,57 @@
  */
 
 #include <sys/types.h>
-#include <sys/endian.h>
-#include <sys/mman.h>
-#include <sys/pciio.h>
-#include <dev/pci/pcireg.h>
 #include <assert.h>
 #include <err.h>
-#include <fcntl.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <cvmx.h>
 #include <cvmx-ciu-defs.h>
-
+#include <cvmx-dpi-defs.h>
+#include <cvmx-l2c-defs.h>
+#include <cvmx-lmcx-defs.h>
+#include <cvmx-pemx-defs.h>
+
+#include "apply.h"
+#include "console.h"
+#include "cores.h"
+#include "csr.h"
 #include "cvmx_compat.h"
+#include "dma.h"
 #include "eeprom.h"
+#include "fuse.h"
+#include "host.h"
+#include "link.h"
+#include "lock.h"
+#include "mbox.h"
+#include "mmio.h"
+#include "profile.h"
 #include "target.h"
+#include "timing.h"
+#include "twsi.h"
 
 #ifndef	howmany
 #define	howmany(a)	(sizeof (a) / sizeof *(a))
 #endif
 
-#define	MAX_TARGET_UNITS	(16)
-#define	MAX_TARGET_MATCHES	(1024)
-
-static struct target target_units[MAX_TARGET_UNITS];
-static unsigned target_unit_next;
+static struct target **target_units;
+static unsigned target_unit_count;
+static unsigned target_unit_size;
 
 #define	TARGET_SELECTED_EACH(ts, a)					\
 	do {								\
 		unsigned n;						\
 									\
-		for (n = 0; n < TARGET_SELECTOR_COUNT; n++) {		\
+		TARGET_SELECTOR_FOREACH((ts), n) {			\
 			struct target *t;				\
 									\
-			if (!TARGET_SELECTED((ts), (n)))		\
-				continue;				\
-			t = &target_units[n];				\
+			assert(n < target_unit_count);			\
+			t = target_units[n];				\
 			assert(t->t_model != NULL);			\
 									\
 			cvmx_select_target(t);				\
@@ -77,38 +89,63 @@ static unsigned target_unit_next;
  * users.  Map logical BAR numbers to the actual registers.
  */
 static const unsigned target_pci_bar_regs[TARGET_BARS] = {
-	PCIR_BAR(0),
-	PCIR_BAR(2)
+	0,
+	2
 };
 
 /*
- * Provide 32-bit little-endian access to resources in
- * BAR0.
+ * BAR1 is divided into 16 pages of 4MB, each of which maps
+ * the target memory selected by a PEM BAR1 index entry.  We
+ * use the last entry for our own accesses to target memory,
+ * leaving the others to software on the target.
+ */
+#define	TARGET_BAR1_PAGE_SHIFT	(22)
+#define	TARGET_BAR1_PAGE_SIZE	(1ull << TARGET_BAR1_PAGE_SHIFT)
+#define	TARGET_BAR1_INDEX	(15)
+#define	TARGET_BAR1_PAGE_NONE	(~0ull)
+
+/*
+ * Transfers at least this large go through the DMA engine,
+ * when it is available, rather than through BAR1.
+ */
+#define	TARGET_DMA_THRESHOLD	(16384)
+
+/*
+ * Buffer size for mem dump and load.
+ */
+#define	TARGET_MEM_BUFFER	(1024 * 1024)
+
+/*
+ * Provide little-endian access to registers in BAR0.  64-bit
+ * registers are accessed in a single transaction where both
+ * the host and the target part allow it, and otherwise as two
+ * 32-bit halves.
  */
 static inline uint32_t
 target_bar0_read4(const struct target *t, uint64_t addr)
 {
-	volatile uint32_t *p;
-
 	assert(addr + 4 <= t->t_pci_bar[0].tb_length);
 
-	p = (void *)(t->t_pci_bar[0].tb_virtual + addr);
-
-	return (le32toh(p[0]));
+	return (mmio_read4(t->t_pci_bar[0].tb_virtual + addr));
 }
 
 static inline uint64_t
 target_bar0_read8(const struct target *t, uint64_t addr)
 {
-	volatile uint32_t *p;
 	uint64_t hi, lo;
+	uintptr_t va;
 
 	assert(addr + 8 <= t->t_pci_bar[0].tb_length);
 
-	p = (void *)(t->t_pci_bar[0].tb_virtual + addr);
+	va = t->t_pci_bar[0].tb_virtual + addr;
 
-	hi = le32toh(p[1]);
-	lo = le32toh(p[0]);
+#if MMIO_NATIVE64
+	if (t->t_bar0_mmio64)
+		return (mmio_read8(va));
+#endif
+
+	hi = mmio_read4(va + 4);
+	lo = mmio_read4(va);
 
 	return (hi << 32 | lo);
 }
@@ -116,99 +153,227 @@ target_bar0_read8(const struct target *t, uint64_t addr)
 static inline void
 target_bar0_write8(const struct target *t, uint64_t addr, uint64_t data)
 {
-	volatile uint32_t *p;
-	uint32_t hi, lo;
+	uintptr_t va;
 
 	assert(addr + 8 <= t->t_pci_bar[0].tb_length);
 
-	p = (void *)(t->t_pci_bar[0].tb_virtual + addr);
+	va = t->t_pci_bar[0].tb_virtual + addr;
+
+#if MMIO_NATIVE64
+	if (t->t_bar0_mmio64) {
+		mmio_write8(va, data);
+		return;
+	}
+#endif
 
 	/*
 	 * NB:
-	 * We always write the low word last, since typically
-	 * it is write to the low address that triggers the
-	 * result of this write, while write to the high
-	 * address merely sets up data.
+	 * When writing a word at a time, we always write the
+	 * low word last, since typically it is write to the
+	 * low address that triggers the result of this write,
+	 * while write to the high address merely sets up data.
 	 */
-	hi = (uint32_t)(data >> 32);
-	lo = (uint32_t)data;
-	p[1] = htole32(hi);
-	p[0] = htole32(lo);
+	mmio_write4(va + 4, (uint32_t)(data >> 32));
+	mmio_write4(va, (uint32_t)data);
 }
 
-struct target_pci_id {
-	uint16_t tpi_vendor;
-	uint16_t tpi_device;
-	uint32_t tpi_chip_id_base;
-	const char *tpi_model;
+/*
+ * Supported target models, by PCI ID.  Octeon III parts are not
+ * listed: they reset through RST_SOFT_RST and RST_PP_RESET and have
+ * CIU3 in place of the CIU registers used here, and the SDK we build
+ * against does not describe them.  L2C TADs are counted only where
+ * they have Octeon II-style performance counters.
+ *
+ * tm_mmio64 says whether BAR0 registers may be accessed 64 bits at a
+ * time.  It is left clear on Octeon II parts, whose window registers
+ * are accessed a word at a time as in Cavium's own code, until single
+ * 64-bit window writes have been verified on them.
+ */
+struct target_model {
+	uint16_t tm_vendor;
+	uint16_t tm_device;
+	uint32_t tm_chip_id_base;
+	const char *tm_name;
+	bool tm_mmio64;
+	enum target_win_access tm_win_access;
+	unsigned tm_lmcs;
+	unsigned tm_l2c_tads;
 };
 
-static const struct target_pci_id target_pci_ids[] = {
-	{ 0x177d, 0x0092, OCTEON_CN66XX_PASS1_0, "Cavium Octeon CN66XX" }
+static const struct target_model target_models[] = {
+	{ 0x177d, 0x0090, OCTEON_CN63XX_PASS1_0, "Cavium Octeon CN63XX", false, TARGET_WIN_ACCESS_SPLIT32, 1, 1 },
+	{ 0x177d, 0x0091, OCTEON_CN68XX_PASS1_0, "Cavium Octeon CN68XX", false, TARGET_WIN_ACCESS_SPLIT32, 4, 4 },
+	{ 0x177d, 0x0092, OCTEON_CN66XX_PASS1_0, "Cavium Octeon CN66XX", false, TARGET_WIN_ACCESS_SPLIT32, 1, 1 },
+	{ 0x177d, 0x0093, OCTEON_CN61XX_PASS1_0, "Cavium Octeon CN61XX", false, TARGET_WIN_ACCESS_SPLIT32, 1, 1 },
 };
 
-static int target_pci_fd = -1;
-static int target_mem_fd = -1;
+bool target_bar1_write_combining;
+uint64_t target_dma_scratch;
 
 static void target_boot_one(struct target *);
+static void target_call_one(struct target *, const struct mbox_msg *, unsigned);
+static void target_mem_dump_one(struct target *, uint64_t, uint64_t, const char *);
+static void target_mem_load_one(struct target *, uint64_t, const char *);
 static void target_reset_one(struct target *);
-static void target_show_one(struct target *);
-static struct target *target_attach(const struct pci_conf *);
+static void target_show_one(struct target *, bool);
+static host_pci_attach_t target_attach;
+static void target_bar1_map(struct target *, uint64_t);
+static uintptr_t target_mem_word(struct target *, uint64_t, size_t);
+static uint64_t target_window_read(const struct target *, uint64_t);
+static void target_window_write(const struct target *, uint64_t, uint64_t);
+static void target_csrs_resolve(struct target *);
+static struct target **target_selected_array(const struct target_selector *, unsigned *);
+
+/*
+ * Set of units attached during target_identify.
+ */
+static struct target_selector *target_identified;
 
-struct target_selector
-target_identify(void)
+void
+target_identify(struct target_selector *all)
 {
-	struct pci_match_conf pmc[howmany(target_pci_ids)];
-	struct pci_conf pcs[MAX_TARGET_MATCHES];
-	struct target_selector all;
-	struct pci_conf_io pci;
+	struct host_pci_id ids[howmany(target_models)];
+	uint64_t start;
 	unsigned i;
-	int rv;
 
-	memset(&pci, 0, sizeof pci);
+	start = timing_start();
 
-	if (target_pci_fd == -1) {
-		target_pci_fd = open("/dev/pci", O_RDONLY);
-		if (target_pci_fd == -1)
-			err(1, "open /dev/pci");
+	for (i = 0; i < howmany(target_models); i++) {
+		ids[i].hpi_vendor = target_models[i].tm_vendor;
+		ids[i].hpi_device = target_models[i].tm_device;
 	}
 
-	pci.match_buf_len = sizeof pcs;
-	pci.matches = pcs;
+	TARGET_SELECTOR_CLEAR(all);
 
-	for (i = 0; i < howmany(target_pci_ids); i++) {
-		pmc[i].pc_vendor = target_pci_ids[i].tpi_vendor;
-		pmc[i].pc_device = target_pci_ids[i].tpi_device;
-		pmc[i].flags = PCI_GETCONF_MATCH_VENDOR | PCI_GETCONF_MATCH_DEVICE;
-	}
+	target_identified = all;
+	host_pci_enumerate(ids, howmany(ids), target_attach);
+	target_identified = NULL;
+
+	timing_report(timing_start() - start);
+}
+
+/*
+ * Targets are brought to their desired state in parallel, each in a
+ * process of its own, and do not need to be selected for the SDK.
+ */
+void
+target_apply(const struct target_selector *ts, const struct apply_state *states, unsigned nstates, bool dryrun)
+{
+	struct target **targets;
+	unsigned n;
 
-	pci.num_patterns = howmany(pmc);
-	pci.pat_buf_len = sizeof pmc;
-	pci.patterns = pmc;
+	targets = target_selected_array(ts, &n);
+	target_apply_run(targets, n, states, nstates, dryrun);
+	free(targets);
+}
 
-	rv = ioctl(target_pci_fd, PCIOCGETCONF, &pci);
-	if (rv == -1)
-		err(1, "ioctl PCIOCGETCONF");
+void
+target_boot(const struct target_selector *ts)
+{
+	TARGET_SELECTED_EACH(ts, target_boot_one(t));
+}
 
-	TARGET_SELECTOR_CLEAR(&all);
+void
+target_call(const struct target_selector *ts, const struct mbox_msg *req, unsigned nreq)
+{
+	TARGET_SELECTED_EACH(ts, target_call_one(t, req, nreq));
+}
 
-	for (i = 0; i < pci.num_matches; i++) {
-		struct target *t;
+void
+target_cores(const struct target_selector *ts, const struct target_cores_req *tcr)
+{
+	TARGET_SELECTED_EACH(ts, target_cores_run(t, tcr));
+}
 
-		t = target_attach(&pci.matches[i]);
-		if (t == NULL)
-			continue;
+/*
+ * Consoles of all selected targets are followed at once, so the
+ * targets are not selected for the SDK, which the console code does
+ * not need.
+ */
+void
+target_console(const struct target_selector *ts, unsigned console, const char *prefix)
+{
+	struct target **targets;
+	unsigned n;
+
+	targets = target_selected_array(ts, &n);
+	target_console_run(targets, n, console, prefix);
+	free(targets);
+}
+
+/*
+ * Gather the selected targets into an array, for the commands which
+ * work on all of them at once rather than selecting each in turn for
+ * the SDK.  The caller frees the array.
+ */
+static struct target **
+target_selected_array(const struct target_selector *ts, unsigned *countp)
+{
+	struct target **targets;
+	unsigned i, n;
+
+	targets = calloc(TARGET_SELECTED_COUNT(ts), sizeof *targets);
+	if (targets == NULL)
+		err(1, "calloc");
 
-		TARGET_SELECT(&all, t->t_unit);
+	i = 0;
+	TARGET_SELECTOR_FOREACH(ts, n) {
+		assert(n < target_unit_count);
+		targets[i++] = target_units[n];
 	}
+	*countp = i;
+	return (targets);
+}
+
+/*
+ * As with consoles, all selected targets are sampled together.
+ */
+void
+target_profile(const struct target_selector *ts, unsigned interval, unsigned samples, const char *path)
+{
+	struct target **targets;
+	unsigned n;
+	FILE *fp;
+
+	targets = target_selected_array(ts, &n);
+
+	if (path == NULL) {
+		fp = stdout;
+	} else {
+		fp = fopen(path, "w");
+		if (fp == NULL)
+			err(1, "fopen %s", path);
+	}
+
+	target_profile_run(targets, n, interval, samples, fp);
 
-	return (all);
+	if (fp != stdout && fclose(fp) != 0)
+		err(1, "fclose %s", path);
+	free(targets);
 }
 
 void
-target_boot(const struct target_selector *ts)
+target_csr(const struct target_selector *ts, const struct csr_op *ops, unsigned nops)
 {
-	TARGET_SELECTED_EACH(ts, target_boot_one(t));
+	TARGET_SELECTED_EACH(ts, target_csr_run(t, ops, nops));
+}
+
+void
+target_fuses(const struct target_selector *ts)
+{
+	TARGET_SELECTED_EACH(ts, target_fuse_dump(t));
+}
+
+void
+target_mem_dump(const struct target_selector *ts, uint64_t addr, uint64_t len, const char *path)
+{
+	TARGET_SELECTED_EACH(ts, target_mem_dump_one(t, addr, len, path));
+}
+
+void
+target_mem_load(const struct target_selector *ts, uint64_t addr, const char *path)
+{
+	TARGET_SELECTED_EACH(ts, target_mem_load_one(t, addr, path));
 }
 
 void
@@ -218,17 +383,101 @@ target_reset(const struct target_selector *ts)
 }
 
 void
-target_show(const struct target_selector *ts)
+target_show(const struct target_selector *ts, bool probe)
 {
-	TARGET_SELECTED_EACH(ts, target_show_one(t));
+	TARGET_SELECTED_EACH(ts, target_show_one(t, probe));
+}
+
+void
+target_twsi(const struct target_selector *ts, const struct twsi_op *to)
+{
+	TARGET_SELECTED_EACH(ts, target_twsi_run(t, to));
 }
 
 uint64_t
 target_read_csr(const struct target *t, uint64_t addr)
 {
+	uint64_t data;
+
+	target_lock(t, TARGET_LOCK_WIN_RD);
+	data = target_window_read(t, addr);
+	target_unlock(t, TARGET_LOCK_WIN_RD);
+
+	return (data);
+}
+
+/*
+ * Read a set of CSRs back to back, so that their values are as
+ * close together in time as the window allows, for callers which
+ * compare them or sample them periodically.  The window is locked
+ * once for the whole batch.
+ */
+void
+target_read_csr_batch(const struct target *t, const uint64_t *addrs, uint64_t *vals, unsigned n)
+{
+	unsigned i;
+
+	target_lock(t, TARGET_LOCK_WIN_RD);
+	for (i = 0; i < n; i++)
+		vals[i] = target_window_read(t, addrs[i]);
+	target_unlock(t, TARGET_LOCK_WIN_RD);
+}
+
+/*
+ * SLI registers are in BAR0 and are read directly, without
+ * going through the window.
+ */
+uint64_t
+target_read_sli(const struct target *t, uint64_t addr)
+{
+	return (target_bar0_read8(t, addr));
+}
+
+void
+target_write_sli(const struct target *t, uint64_t addr, uint64_t data)
+{
+	target_bar0_write8(t, addr, data);
+}
+
+void
+target_write_csr(const struct target *t, uint64_t addr, uint64_t data)
+{
+	target_lock(t, TARGET_LOCK_WIN_WR);
+	target_window_write(t, addr, data);
+	target_unlock(t, TARGET_LOCK_WIN_WR);
+}
+
+void
+target_bar1_read(const struct target *t, uint64_t offset, void *buf, size_t len)
+{
+	assert(t->t_pci_bar[1].tb_enabled);
+	assert(offset + len <= t->t_pci_bar[1].tb_length);
+
+	mmio_copyin(buf, t->t_pci_bar[1].tb_virtual + offset, len);
+}
+
+void
+target_bar1_write(const struct target *t, uint64_t offset, const void *buf, size_t len)
+{
+	assert(t->t_pci_bar[1].tb_enabled);
+	assert(offset + len <= t->t_pci_bar[1].tb_length);
+
+	mmio_copyout(t->t_pci_bar[1].tb_virtual + offset, buf, len);
+}
+
+/*
+ * Single transactions through the SLI window, for which the
+ * caller holds the window's lock.
+ */
+static uint64_t
+target_window_read(const struct target *t, uint64_t addr)
+{
+	const struct target_csrs *tc;
 	cvmx_sli_win_rd_addr_t swra;
 	uint32_t hi, lo;
 
+	tc = &t->t_csrs;
+
 	/*
 	 * XXX
 	 * In theory we should just be writing addr to rd_addr,
@@ -236,7 +485,7 @@ target_read_csr(const struct target *t, uint64_t addr)
 	 */
 	swra.u64 = addr;
 	swra.s.ld_cmd = 3;
-	target_bar0_write8(t, CVMX_SLI_WIN_RD_ADDR, swra.u64);
+	target_bar0_write8(t, tc->tc_sli_win_rd_addr, swra.u64);
 
 	/*
 	 * Since we do two 32-bit reads, accessing the low
@@ -253,25 +502,32 @@ target_read_csr(const struct target *t, uint64_t addr)
 	 * from LAST_WIN_RDATA[01] after peeking at
 	 * WIN_RD_DATA, but that's an extra read for no
 	 * clear benefit.
+	 *
+	 * Where both host and target support it, a single
+	 * 64-bit read of WIN_RD_DATA does the whole job.  A
+	 * target with native window access always has
+	 * t_bar0_mmio64 set on such a host.
 	 */
-	lo = target_bar0_read4(t, CVMX_SLI_WIN_RD_DATA);
-	if (t->t_pcie_port == 0)
-		hi = target_bar0_read4(t, CVMX_SLI_LAST_WIN_RDATA0 + 4);
-	else
-		hi = target_bar0_read4(t, CVMX_SLI_LAST_WIN_RDATA1 + 4);
+	if (tc->tc_sli_win_access == TARGET_WIN_ACCESS_NATIVE64)
+		return (target_bar0_read8(t, tc->tc_sli_win_rd_data));
+	lo = target_bar0_read4(t, tc->tc_sli_win_rd_data);
+	hi = target_bar0_read4(t, tc->tc_sli_last_win_rdata + 4);
 	return ((uint64_t)hi << 32 | lo);
 }
 
-void
-target_write_csr(const struct target *t, uint64_t addr, uint64_t data)
+static void
+target_window_write(const struct target *t, uint64_t addr, uint64_t data)
 {
 	cvmx_sli_win_wr_addr_t swwa;
 	cvmx_sli_win_wr_data_t swwd;
 	cvmx_sli_win_wr_mask_t swwm;
+	const struct target_csrs *tc;
+
+	tc = &t->t_csrs;
 
 	swwm.u64 = 0;
 	swwm.s.wr_mask = 0xff; /* Write all 8 bytes.  */
-	target_bar0_write8(t, CVMX_SLI_WIN_WR_MASK, swwm.u64);
+	target_bar0_write8(t, tc->tc_sli_win_wr_mask, swwm.u64);
 
 	/*
 	 * XXX
@@ -279,134 +535,446 @@ target_write_csr(const struct target *t, uint64_t addr, uint64_t data)
 	 * is true of WIN_WR_ADDR!
 	 */
 	swwa.u64 = addr;
-	target_bar0_write8(t, CVMX_SLI_WIN_WR_ADDR, swwa.u64);
+	target_bar0_write8(t, tc->tc_sli_win_wr_addr, swwa.u64);
 
 	/*
 	 * XXX
-	 * It's the write to the low word that triggers the
-	 * actual write, so we rely on the ordering of the
-	 * writes in target_bar0_write8.
+	 * Where BAR0 is written a word at a time, as it is
+	 * on Octeon II parts, it's the write to the low word
+	 * that triggers the actual write, so we rely on the
+	 * ordering of the writes in target_bar0_write8.
+	 * Where t_bar0_mmio64 is set, the data goes out in a
+	 * single 64-bit write.
 	 *
 	 * Perhaps we should split the write here to make it
 	 * more explicit, but so far not.
 	 */
 	swwd.u64 = 0;
 	swwd.s.wr_data = data;
-	target_bar0_write8(t, CVMX_SLI_WIN_WR_DATA, swwd.u64);
+	target_bar0_write8(t, tc->tc_sli_win_wr_data, swwd.u64);
+}
+
+/*
+ * Access target memory.  Large transfers use the DMA engine where
+ * it is available; everything else goes through our BAR1 page,
+ * which maps target memory one 4MB page at a time.
+ */
+void
+target_mem_read(struct target *t, uint64_t addr, void *buf, size_t len)
+{
+	uint64_t offset, page;
+	uint8_t *p;
+	size_t n;
+
+	if (len >= TARGET_DMA_THRESHOLD && target_dma_read(t, addr, buf, len))
+		return;
+
+	if (!t->t_pci_bar[1].tb_enabled)
+		errx(1, "target%u: BAR1 not available for memory access.", t->t_unit);
+
+	target_lock(t, TARGET_LOCK_BAR1);
+	p = buf;
+	while (len != 0) {
+		page = addr >> TARGET_BAR1_PAGE_SHIFT;
+		offset = addr & (TARGET_BAR1_PAGE_SIZE - 1);
+		n = TARGET_BAR1_PAGE_SIZE - offset;
+		if (n > len)
+			n = len;
+
+		target_bar1_map(t, page);
+		target_bar1_read(t, TARGET_BAR1_INDEX * TARGET_BAR1_PAGE_SIZE + offset, p, n);
+
+		addr += n;
+		p += n;
+		len -= n;
+	}
+	target_unlock(t, TARGET_LOCK_BAR1);
+}
+
+void
+target_mem_write(struct target *t, uint64_t addr, const void *buf, size_t len)
+{
+	uint64_t offset, page;
+	const uint8_t *p;
+	size_t n;
+
+	if (len >= TARGET_DMA_THRESHOLD && target_dma_write(t, addr, buf, len))
+		return;
+
+	if (!t->t_pci_bar[1].tb_enabled)
+		errx(1, "target%u: BAR1 not available for memory access.", t->t_unit);
+
+	target_lock(t, TARGET_LOCK_BAR1);
+	p = buf;
+	while (len != 0) {
+		page = addr >> TARGET_BAR1_PAGE_SHIFT;
+		offset = addr & (TARGET_BAR1_PAGE_SIZE - 1);
+		n = TARGET_BAR1_PAGE_SIZE - offset;
+		if (n > len)
+			n = len;
+
+		target_bar1_map(t, page);
+		target_bar1_write(t, TARGET_BAR1_INDEX * TARGET_BAR1_PAGE_SIZE + offset, p, n);
+
+		addr += n;
+		p += n;
+		len -= n;
+	}
+	target_unlock(t, TARGET_LOCK_BAR1);
+}
+
+/*
+ * Single accesses to naturally-aligned big-endian words of target
+ * memory, for indexes shared with software on the target, which a
+ * copy might otherwise split.  Hosts without native 64-bit accesses
+ * can only read or write a 64-bit word as two halves, high first.
+ */
+uint32_t
+target_mem_read4(struct target *t, uint64_t addr)
+{
+	uint32_t v;
+
+	target_lock(t, TARGET_LOCK_BAR1);
+	v = mmio_read4_be(target_mem_word(t, addr, sizeof v));
+	target_unlock(t, TARGET_LOCK_BAR1);
+
+	return (v);
+}
+
+uint64_t
+target_mem_read8(struct target *t, uint64_t addr)
+{
+	uintptr_t va;
+	uint64_t v;
+
+	target_lock(t, TARGET_LOCK_BAR1);
+	va = target_mem_word(t, addr, sizeof v);
+#if MMIO_NATIVE64
+	v = mmio_read8_be(va);
+#else
+	v = (uint64_t)mmio_read4_be(va) << 32;
+	v |= mmio_read4_be(va + 4);
+#endif
+	target_unlock(t, TARGET_LOCK_BAR1);
+
+	return (v);
+}
+
+void
+target_mem_write4(struct target *t, uint64_t addr, uint32_t v)
+{
+	target_lock(t, TARGET_LOCK_BAR1);
+	mmio_write4_be(target_mem_word(t, addr, sizeof v), v);
+	target_unlock(t, TARGET_LOCK_BAR1);
+}
+
+void
+target_mem_write8(struct target *t, uint64_t addr, uint64_t v)
+{
+	uintptr_t va;
+
+	target_lock(t, TARGET_LOCK_BAR1);
+	va = target_mem_word(t, addr, sizeof v);
+#if MMIO_NATIVE64
+	mmio_write8_be(va, v);
+#else
+	mmio_write4_be(va, v >> 32);
+	mmio_write4_be(va + 4, (uint32_t)v);
+#endif
+	target_unlock(t, TARGET_LOCK_BAR1);
 }
 
-static struct target *
-target_attach(const struct pci_conf *pc)
+/*
+ * Map the page holding a word of target memory and return the word's
+ * address.  The caller holds TARGET_LOCK_BAR1.
+ */
+static uintptr_t
+target_mem_word(struct target *t, uint64_t addr, size_t size)
 {
-	const struct target_pci_id *tpi;
+	if (addr % size != 0)
+		errx(1, "target%u: unaligned %zu-byte access at %#jx.", t->t_unit, size, (uintmax_t)addr);
+	if (!t->t_pci_bar[1].tb_enabled)
+		errx(1, "target%u: BAR1 not available for memory access.", t->t_unit);
+
+	target_bar1_map(t, addr >> TARGET_BAR1_PAGE_SHIFT);
+	return (t->t_pci_bar[1].tb_virtual + TARGET_BAR1_INDEX * TARGET_BAR1_PAGE_SIZE +
+	    (addr & (TARGET_BAR1_PAGE_SIZE - 1)));
+}
+
+/*
+ * Point our BAR1 index entry at a page of target memory.  The
+ * page is cached in the L2 so that our accesses are coherent
+ * with the cores, and bytes are not swapped, so multi-byte
+ * quantities read through BAR1 are big-endian.  The caller
+ * holds TARGET_LOCK_BAR1.
+ */
+static void
+target_bar1_map(struct target *t, uint64_t page)
+{
+	cvmx_pemx_bar1_indexx_t pbi;
+	uint64_t current;
+
+	/*
+	 * Once we have set the entry ourselves, trust the record
+	 * in the lock file of what it now maps, since another
+	 * process may have moved it.
+	 */
+	current = t->t_bar1_page;
+	if (current != TARGET_BAR1_PAGE_NONE)
+		(void)target_lock_bar1_page(t, &current);
+	if (current == page) {
+		t->t_bar1_page = page;
+		return;
+	}
+
+	if (t->t_pci_bar[1].tb_length < (TARGET_BAR1_INDEX + 1) * TARGET_BAR1_PAGE_SIZE)
+		errx(1, "target%u: BAR1 too small for memory access.", t->t_unit);
+
+	pbi.u64 = 0;
+	pbi.s.addr_idx = page;
+	pbi.s.ca = 1;
+	pbi.s.end_swp = 0;
+	pbi.s.addr_v = 1;
+	target_write_csr(t, t->t_csrs.tc_pem_bar1_index, pbi.u64);
+
+	/*
+	 * Read back the entry so that the update has taken
+	 * effect before we access the page through BAR1.
+	 */
+	(void)target_read_csr(t, t->t_csrs.tc_pem_bar1_index);
+
+	t->t_bar1_page = page;
+	target_lock_set_bar1_page(t, page);
+}
+
+static void
+target_attach(const struct host_pci_dev *hpd)
+{
+	const struct target_model *tm;
 	struct eeprom_board_desc ebd;
-	cvmx_mio_tws_sw_twsi_t mtst;
 	cvmx_sli_ctl_status_t scs;
 	cvmx_sli_mac_number_t smn;
-	struct pci_bar_io pbi;
+	struct host_bar hb;
 	cvmx_ciu_fuse_t cf;
+	uint64_t phase, start;
 	struct target *t;
 	unsigned i;
 	void *m;
-	int rv;
 
-	tpi = NULL;
+	start = timing_start();
+	tm = NULL;
 
-	for (i = 0; i < howmany(target_pci_ids); i++) {
-		if (pc->pc_vendor != target_pci_ids[i].tpi_vendor)
+	for (i = 0; i < howmany(target_models); i++) {
+		if (hpd->hpd_vendor != target_models[i].tm_vendor)
 			continue;
-		if (pc->pc_device != target_pci_ids[i].tpi_device)
+		if (hpd->hpd_device != target_models[i].tm_device)
 			continue;
-		tpi = &target_pci_ids[i];
+		tm = &target_models[i];
 		break;
 	}
 
-	assert(tpi != NULL);
+	assert(tm != NULL);
 
-	if (target_unit_next == MAX_TARGET_UNITS) {
-		fprintf(stderr, "Already have %u units, cannot configure additional <%s>.\n", MAX_TARGET_UNITS, tpi->tpi_model);
-		return (NULL);
-	}
+	if (target_unit_count == target_unit_size) {
+		struct target **units;
+		unsigned size;
 
-	t = &target_units[target_unit_next];
-	t->t_model = tpi->tpi_model;
-	t->t_unit = target_unit_next++;
+		size = target_unit_size == 0 ? 16 : target_unit_size * 2;
+		units = reallocarray(target_units, size, sizeof *units);
+		if (units == NULL)
+			err(1, "reallocarray");
+		target_units = units;
+		target_unit_size = size;
+	}
 
-	t->t_pci_domain = pc->pc_sel.pc_domain;
-	t->t_pci_bus = pc->pc_sel.pc_bus;
-	t->t_pci_slot = pc->pc_sel.pc_dev;
-	t->t_pci_function = pc->pc_sel.pc_func;
+	t = calloc(1, sizeof *t);
+	if (t == NULL)
+		err(1, "calloc");
+	target_units[target_unit_count] = t;
 
-	for (i = 0; i < TARGET_BARS; i++) {
-		memset(&pbi, 0, sizeof pbi);
+	t->t_model = tm;
+	t->t_bar0_mmio64 = MMIO_NATIVE64 && tm->tm_mmio64;
+	t->t_unit = target_unit_count++;
 
-		pbi.pbi_sel = pc->pc_sel;
-		pbi.pbi_reg = target_pci_bar_regs[i];
+	t->t_pci = *hpd;
+	t->t_bar1_page = TARGET_BAR1_PAGE_NONE;
+	phase = timing_start();
+	target_lock_open(t);
+	timing_phase(t->t_unit, TIMING_LOCK, phase);
 
-		assert(target_pci_fd != -1);
+	phase = timing_start();
+	target_link_attach(t);
+	timing_phase(t->t_unit, TIMING_LINK, phase);
 
-		rv = ioctl(target_pci_fd, PCIOCGETBAR, &pbi);
-		if (rv == -1) {
+	for (i = 0; i < TARGET_BARS; i++) {
+		phase = timing_start();
+		if (!host_pci_bar(hpd, target_pci_bar_regs[i], &hb)) {
+			timing_phase(t->t_unit, TIMING_BAR, phase);
 			t->t_pci_bar[i].tb_enabled = false;
 			continue;
 		}
+		timing_phase(t->t_unit, TIMING_BAR, phase);
 
-		t->t_pci_bar[i].tb_enabled = pbi.pbi_enabled != 0;
-		if (!t->t_pci_bar[i].tb_enabled)
-			continue;
-		if (!PCI_BAR_MEM(pbi.pbi_base)) {
+		t->t_pci_bar[i].tb_enabled = true;
+		if (!hb.hb_memory) {
 			fprintf(stderr, "target%u: BAR%u is not a memory BAR; disabling\n", t->t_unit, i);
 			t->t_pci_bar[i].tb_enabled = false;
 			continue;
 		}
-		t->t_pci_bar[i].tb_base = pbi.pbi_base & PCIM_BAR_MEM_BASE;
-		t->t_pci_bar[i].tb_length = pbi.pbi_length;
-
-		if (target_mem_fd == -1) {
-			target_mem_fd = open("/dev/mem", O_RDWR);
-			if (target_mem_fd == -1)
-				err(1, "open /dev/mem");
-		}
-
-		m = mmap(NULL, t->t_pci_bar[i].tb_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NOCORE, target_mem_fd, t->t_pci_bar[i].tb_base);
-		if (m == MAP_FAILED) {
+		t->t_pci_bar[i].tb_base = hb.hb_base;
+		t->t_pci_bar[i].tb_length = hb.hb_length;
+
+		phase = timing_start();
+		m = host_pci_bar_map(hpd, target_pci_bar_regs[i], &hb,
+		    i == 1 && target_bar1_write_combining,
+		    &t->t_pci_bar[i].tb_write_combining);
+		timing_phase(t->t_unit, TIMING_MAP, phase);
+		if (m == NULL) {
 			fprintf(stderr, "target%u: BAR%u could not be mapped; disabling\n", t->t_unit, i);
 			t->t_pci_bar[i].tb_enabled = false;
 			continue;
 		}
 
 		t->t_pci_bar[i].tb_virtual = (uintptr_t)m;
+
+		if (i == 1 && target_bar1_write_combining &&
+		    !t->t_pci_bar[i].tb_write_combining)
+			fprintf(stderr, "target%u: BAR%u could not be made write-combining\n", t->t_unit, i);
 	}
 
+	phase = timing_start();
 	smn.u64 = target_bar0_read8(t, CVMX_SLI_MAC_NUMBER);
 	t->t_pcie_port = smn.s.num;
 
 	scs.u64 = target_bar0_read8(t, CVMX_SLI_CTL_STATUS);
-	t->t_chip_id = tpi->tpi_chip_id_base | scs.s.chip_rev;
-
-	cf.u64 = target_read_csr(t, CVMX_CIU_FUSE);
-	t->t_core_mask = cf.u64;
+	t->t_chip_id = tm->tm_chip_id_base | scs.s.chip_rev;
 
 	/*
-	 * Configure TWSI clock per Cavium code.
+	 * Now that the model is known, resolve the remaining
+	 * CSR addresses, including the SLI window registers
+	 * used by target_read_csr and target_write_csr.
 	 */
-	for (i = 0; i < 2; i++) {
-		mtst.u64 = 0;
-		mtst.s.v = 1;
-		mtst.s.op = 0x6;
-		mtst.s.eop_ia = 0x3;
-		mtst.s.d = 0xf << 3;
-		target_write_csr(t, CVMX_MIO_TWSX_SW_TWSI(i), mtst.u64);
-	}
+	cvmx_select_target(t);
+	target_csrs_resolve(t);
+	cvmx_select_target(NULL);
+	timing_phase(t->t_unit, TIMING_SLI, phase);
+
+	phase = timing_start();
+	cf.u64 = target_read_csr(t, t->t_csrs.tc_ciu_fuse);
+	t->t_core_mask = cf.u64;
+	timing_phase(t->t_unit, TIMING_FUSE, phase);
 
+	phase = timing_start();
 	cvmx_select_target(t);
-	if (!eeprom_board_desc_read(&ebd))
+	target_twsi_attach(t);
+	cvmx_select_target(NULL);
+	timing_phase(t->t_unit, TIMING_TWSI, phase);
+
+	phase = timing_start();
+	if (!eeprom_board_desc_read(t, &ebd))
 		t->t_board_type = CVMX_BOARD_TYPE_NULL;
 	else
 		t->t_board_type = ebd.ebd_board_type;
-	cvmx_select_target(NULL);
+	timing_phase(t->t_unit, TIMING_EEPROM, phase);
+
+	timing_attach(t->t_unit, start);
+
+	TARGET_SELECT(target_identified, t->t_unit);
+}
+
+/*
+ * Evaluate the model-dependent CSR address macros once for a
+ * target, which must be selected so that OCTEON_IS_MODEL checks
+ * see its chip ID.
+ */
+static void
+target_csrs_resolve(struct target *t)
+{
+	struct target_csrs *tc;
+	unsigned i;
+
+	tc = &t->t_csrs;
+
+	tc->tc_sli_win_rd_addr = CVMX_SLI_WIN_RD_ADDR;
+	tc->tc_sli_win_rd_data = CVMX_SLI_WIN_RD_DATA;
+	tc->tc_sli_win_wr_addr = CVMX_SLI_WIN_WR_ADDR;
+	tc->tc_sli_win_wr_data = CVMX_SLI_WIN_WR_DATA;
+	tc->tc_sli_win_wr_mask = CVMX_SLI_WIN_WR_MASK;
+
+	/*
+	 * Without native 64-bit accesses on this host, fall
+	 * back to split reads even where the target supports
+	 * single 64-bit window accesses.
+	 */
+	tc->tc_sli_win_access = t->t_model->tm_win_access;
+	if (!t->t_bar0_mmio64)
+		tc->tc_sli_win_access = TARGET_WIN_ACCESS_SPLIT32;
+	switch (t->t_pcie_port) {
+	case 0:
+		tc->tc_sli_last_win_rdata = CVMX_SLI_LAST_WIN_RDATA0;
+		break;
+	case 1:
+		tc->tc_sli_last_win_rdata = CVMX_SLI_LAST_WIN_RDATA1;
+		break;
+#ifdef CVMX_SLI_LAST_WIN_RDATA2
+	case 2:
+		tc->tc_sli_last_win_rdata = CVMX_SLI_LAST_WIN_RDATA2;
+		break;
+	case 3:
+		tc->tc_sli_last_win_rdata = CVMX_SLI_LAST_WIN_RDATA3;
+		break;
+#endif
+	default:
+		if (tc->tc_sli_win_access != TARGET_WIN_ACCESS_NATIVE64)
+			errx(1, "target%u: no LAST_WIN_RDATA for PCIe port %u", t->t_unit, t->t_pcie_port);
+		tc->tc_sli_last_win_rdata = 0;
+		break;
+	}
+	tc->tc_sli_scratch_1 = CVMX_SLI_SCRATCH_1;
+	tc->tc_sli_scratch_2 = CVMX_SLI_SCRATCH_2;
+
+	tc->tc_ciu_dint = CVMX_CIU_DINT;
+	tc->tc_ciu_fuse = CVMX_CIU_FUSE;
+	tc->tc_ciu_pp_dbg = CVMX_CIU_PP_DBG;
+	tc->tc_ciu_pp_rst = CVMX_CIU_PP_RST;
+	tc->tc_ciu_soft_bist = CVMX_CIU_SOFT_BIST;
+	tc->tc_ciu_soft_rst = CVMX_CIU_SOFT_RST;
+
+	tc->tc_dpi_ctl = CVMX_DPI_CTL;
+	tc->tc_dpi_dma_control = CVMX_DPI_DMA_CONTROL;
+	for (i = 0; i < howmany(tc->tc_dpi_dma_engx_en); i++)
+		tc->tc_dpi_dma_engx_en[i] = CVMX_DPI_DMA_ENGX_EN(i);
+	tc->tc_dpi_dmax_dbell = CVMX_DPI_DMAX_DBELL(TARGET_DMA_QUEUE);
+	tc->tc_dpi_dmax_ibuff_saddr = CVMX_DPI_DMAX_IBUFF_SADDR(TARGET_DMA_QUEUE);
+
+	tc->tc_lmc_reset_ctl = CVMX_LMCX_RESET_CTL(0);
+	tc->tc_lmcs = t->t_model->tm_lmcs;
+	assert(tc->tc_lmcs <= howmany(tc->tc_lmcx_ops_cnt));
+	for (i = 0; i < tc->tc_lmcs; i++) {
+		tc->tc_lmcx_ops_cnt[i] = CVMX_LMCX_OPS_CNT(i);
+		tc->tc_lmcx_ifb_cnt[i] = CVMX_LMCX_IFB_CNT(i);
+		tc->tc_lmcx_dclk_cnt[i] = CVMX_LMCX_DCLK_CNT(i);
+	}
+
+	tc->tc_l2c_tads = t->t_model->tm_l2c_tads;
+	assert(tc->tc_l2c_tads <= howmany(tc->tc_l2c_tadx_pfc));
+	for (i = 0; i < tc->tc_l2c_tads; i++) {
+		tc->tc_l2c_tadx_pfc[i][0] = CVMX_L2C_TADX_PFC0(i);
+		tc->tc_l2c_tadx_pfc[i][1] = CVMX_L2C_TADX_PFC1(i);
+		tc->tc_l2c_tadx_pfc[i][2] = CVMX_L2C_TADX_PFC2(i);
+		tc->tc_l2c_tadx_pfc[i][3] = CVMX_L2C_TADX_PFC3(i);
+	}
+	if (tc->tc_l2c_tads != 0)
+		tc->tc_l2c_tad_prf = CVMX_L2C_TAD_PRF;
+
+	tc->tc_mio_boot_loc_cfg = CVMX_MIO_BOOT_LOC_CFGX(0);
+	tc->tc_mio_fus_rcmd = CVMX_MIO_FUS_RCMD;
+	for (i = 0; i < howmany(tc->tc_mio_twsx_sw_twsi); i++) {
+		tc->tc_mio_twsx_sw_twsi[i] = CVMX_MIO_TWSX_SW_TWSI(i);
+		tc->tc_mio_twsx_sw_twsi_ext[i] = CVMX_MIO_TWSX_SW_TWSI_EXT(i);
+	}
 
-	return (t);
+	tc->tc_pem_bar1_index = CVMX_PEMX_BAR1_INDEXX(TARGET_BAR1_INDEX, t->t_pcie_port);
 }
 
 static void
@@ -416,44 +984,154 @@ target_boot_one(struct target *t)
 	errx(1, "not yet implemented.");
 }
 
+static void
+target_call_one(struct target *t, const struct mbox_msg *req, unsigned n)
+{
+	struct mbox_msg *rsp;
+	unsigned i, j;
+
+	rsp = calloc(n, sizeof *rsp);
+	if (rsp == NULL)
+		err(1, "calloc");
+
+	if (!target_mbox_call(t, req, rsp, n))
+		errx(1, "target%u: mailbox not available.", t->t_unit);
+
+	for (i = 0; i < n; i++) {
+		printf("target%u: tag %u status %u", t->t_unit, rsp[i].mm_tag, rsp[i].mm_op);
+		if (rsp[i].mm_len != 0) {
+			printf(" data ");
+			for (j = 0; j < rsp[i].mm_len; j++)
+				printf("%02x", rsp[i].mm_data[j]);
+		}
+		printf("\n");
+	}
+
+	free(rsp);
+}
+
+static void
+target_mem_dump_one(struct target *t, uint64_t addr, uint64_t len, const char *path)
+{
+	uint8_t *buf;
+	size_t n;
+	FILE *f;
+
+	if (path == NULL) {
+		f = stdout;
+	} else {
+		f = fopen(path, "w");
+		if (f == NULL)
+			err(1, "fopen %s", path);
+	}
+
+	buf = malloc(TARGET_MEM_BUFFER);
+	if (buf == NULL)
+		err(1, "malloc");
+
+	while (len != 0) {
+		n = len < TARGET_MEM_BUFFER ? len : TARGET_MEM_BUFFER;
+		target_mem_read(t, addr, buf, n);
+		if (fwrite(buf, 1, n, f) != n)
+			err(1, "fwrite");
+		addr += n;
+		len -= n;
+	}
+
+	free(buf);
+	if (f != stdout && fclose(f) != 0)
+		err(1, "fclose %s", path);
+}
+
+static void
+target_mem_load_one(struct target *t, uint64_t addr, const char *path)
+{
+	uint8_t *buf;
+	size_t n;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (f == NULL)
+		err(1, "fopen %s", path);
+
+	buf = malloc(TARGET_MEM_BUFFER);
+	if (buf == NULL)
+		err(1, "malloc");
+
+	while ((n = fread(buf, 1, TARGET_MEM_BUFFER, f)) != 0) {
+		target_mem_write(t, addr, buf, n);
+		addr += n;
+	}
+	if (ferror(f))
+		err(1, "fread %s", path);
+
+	free(buf);
+	fclose(f);
+}
+
 static void
 target_reset_one(struct target *t)
 {
-	target_write_csr(t, CVMX_CIU_SOFT_BIST, 1);
+	const struct target_csrs *tc;
+
+	tc = &t->t_csrs;
 
-	target_read_csr(t, CVMX_CIU_SOFT_RST);
-	target_write_csr(t, CVMX_CIU_SOFT_RST, 1);
+	/*
+	 * The reset may invalidate our BAR1 index entry, so forget
+	 * the page recorded for it, here and for other processes,
+	 * which would otherwise go on trusting the record.
+	 */
+	target_lock(t, TARGET_LOCK_BAR1);
+	t->t_bar1_page = TARGET_BAR1_PAGE_NONE;
+	target_lock_set_bar1_page(t, TARGET_BAR1_PAGE_NONE);
+
+	/*
+	 * SLI_SCRATCH_1 survives a soft reset, and holds the stamp of
+	 * the image last loaded by apply, which memory will no longer
+	 * contain.
+	 */
+	target_write_sli(t, tc->tc_sli_scratch_1, 0);
+
+	target_write_csr(t, tc->tc_ciu_soft_bist, 1);
+
+	target_read_csr(t, tc->tc_ciu_soft_rst);
+	target_write_csr(t, tc->tc_ciu_soft_rst, 1);
+	target_unlock(t, TARGET_LOCK_BAR1);
 }
 
 static void
-target_show_one(struct target *t)
+target_show_one(struct target *t, bool probe)
 {
 	cvmx_lmcx_reset_ctl_t lrc;
 	uint64_t cores;
 	unsigned i;
 
-	printf("target%u <%s> at PCI %08x:%02x:%02x:%02x\n", t->t_unit, t->t_model, t->t_pci_domain, t->t_pci_bus, t->t_pci_slot, t->t_pci_function);
+	printf("target%u <%s> at PCI %08x:%02x:%02x:%02x\n", t->t_unit, t->t_model->tm_name, t->t_pci.hpd_domain, t->t_pci.hpd_bus, t->t_pci.hpd_slot, t->t_pci.hpd_function);
 
 	for (i = 0; i < TARGET_BARS; i++) {
 		if (!t->t_pci_bar[i].tb_enabled) {
 			printf("target%u: BAR%u disabled\n", t->t_unit, i);
 			continue;
 		}
-		printf("target%u: BAR%u %#jx-%#jx (%ju bytes) mapped %p\n", t->t_unit, i,
+		printf("target%u: BAR%u %#jx-%#jx (%ju bytes) mapped %p%s\n", t->t_unit, i,
 		       (uintmax_t)t->t_pci_bar[i].tb_base,
 		       (uintmax_t)(t->t_pci_bar[i].tb_base + t->t_pci_bar[i].tb_length),
 		       (uintmax_t)t->t_pci_bar[i].tb_length,
-		       (void *)t->t_pci_bar[i].tb_virtual);
+		       (void *)t->t_pci_bar[i].tb_virtual,
+		       t->t_pci_bar[i].tb_write_combining ? " write-combining" : "");
 	}
 
 	printf("target%u: PCIe port %u core model 0x%08x (%s)\n", t->t_unit, t->t_pcie_port, t->t_chip_id, octeon_model_get_string(t->t_chip_id));
+	target_link_show(t);
+	if (probe)
+		target_link_probe(t);
 
 	if (t->t_core_mask == 0)
 		printf("target%u: no cores configured\n", t->t_unit);
 	else {
 		printf("target%u: core mask 0x%016jx\n", t->t_unit, (uintmax_t)t->t_core_mask);
 
-		cores = target_read_csr(t, CVMX_CIU_PP_RST);
+		cores = target_read_csr(t, t->t_csrs.tc_ciu_pp_rst);
 		if (cores == 0)
 			printf("target%u: no cores in reset\n", t->t_unit);
 		else if (cores == t->t_core_mask)
@@ -461,7 +1139,7 @@ target_show_one(struct target *t)
 		else
 			printf("target%u: cores in reset 0x%016jx\n", t->t_unit, (uintmax_t)cores);
 
-		cores = target_read_csr(t, CVMX_CIU_PP_DBG);
+		cores = target_read_csr(t, t->t_csrs.tc_ciu_pp_dbg);
 		if (cores == 0)
 			printf("target%u: no cores in debug\n", t->t_unit);
 		else if (cores == t->t_core_mask)
@@ -472,11 +1150,14 @@ target_show_one(struct target *t)
 
 	}
 
-	lrc.u64 = target_read_csr(t, CVMX_LMCX_RESET_CTL(0));
+	lrc.u64 = target_read_csr(t, t->t_csrs.tc_lmc_reset_ctl);
 	printf("target%u: memory %savailable\n", t->t_unit, lrc.s.ddr3rst ? "" : "not ");
 
 	if (t->t_board_type == 0)
 		printf("target%u: unknown board type\n", t->t_unit);
 	else
 		printf("target%u: board type 0x%04hx (%s)\n", t->t_unit, t->t_board_type, cvmx_board_type_to_string(t->t_board_type));
+
+	for (i = 0; i < TWSI_BUSES; i++)
+		printf("target%u: TWSI%u clock %u kHz\n", t->t_unit, i, target_twsi_hz(t, i) / 1000);
 }
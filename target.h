@@ -27,6 +27,7 @@
 #define	TARGET_H
 
 #define	TARGET_BARS	(2)
+#define	TARGET_FUSE_BYTES	(256)
 
 struct target_bar {
 	bool tb_enabled;
@@ -35,48 +36,196 @@ struct target_bar {
 	uint64_t tb_length;
 
 	uintptr_t tb_virtual;
+	bool tb_write_combining;
+};
+
+struct apply_state;
+/*
+ * The target's PCIe link, from the PCI Express capability in its
+ * configuration space.  Speeds are as encoded in the link registers,
+ * 1 for 2.5 GT/s, 2 for 5 GT/s and so on.
+ */
+struct target_link {
+	bool tl_valid;
+
+	unsigned tl_speed;
+	unsigned tl_width;
+	unsigned tl_max_speed;
+	unsigned tl_max_width;
+
+	unsigned tl_max_payload;	/* Bytes.  */
+	unsigned tl_max_payload_cap;	/* Bytes.  */
+	unsigned tl_max_read;		/* Bytes.  */
+};
+
+struct csr_op;
+struct target_cores_req;
+struct mbox_msg;
+struct target_dma;
+struct target_mbox;
+struct target_model;
+struct target_twsi;
+struct twsi_op;
+
+/*
+ * How the SLI window registers are accessed for a target.  Octeon II
+ * parts are read with a 32-bit read of WIN_RD_DATA, which triggers the
+ * window read, followed by a read of the high word from the port's
+ * LAST_WIN_RDATA register.  Parts which accept 64-bit accesses to the
+ * window data registers are read and written with a single access.
+ */
+enum target_win_access {
+	TARGET_WIN_ACCESS_SPLIT32,
+	TARGET_WIN_ACCESS_NATIVE64,
+};
+
+/*
+ * Addresses of the CSRs this tool uses, resolved for the target's
+ * model once at attach time.  With USE_RUNTIME_MODEL_CHECKS, each
+ * CVMX_* address macro would otherwise evaluate OCTEON_IS_MODEL on
+ * every access.
+ */
+struct target_csrs {
+	uint64_t tc_sli_win_rd_addr;
+	uint64_t tc_sli_win_rd_data;
+	uint64_t tc_sli_win_wr_addr;
+	uint64_t tc_sli_win_wr_data;
+	uint64_t tc_sli_win_wr_mask;
+	uint64_t tc_sli_last_win_rdata;	/* For this target's PCIe port.  */
+	enum target_win_access tc_sli_win_access;
+	uint64_t tc_sli_scratch_1;
+	uint64_t tc_sli_scratch_2;
+
+	uint64_t tc_ciu_dint;
+	uint64_t tc_ciu_fuse;
+	uint64_t tc_ciu_pp_dbg;
+	uint64_t tc_ciu_pp_rst;
+	uint64_t tc_ciu_soft_bist;
+	uint64_t tc_ciu_soft_rst;
+
+	uint64_t tc_dpi_ctl;
+	uint64_t tc_dpi_dma_control;
+	uint64_t tc_dpi_dma_engx_en[6];
+	uint64_t tc_dpi_dmax_dbell;		/* For our DMA queue.  */
+	uint64_t tc_dpi_dmax_ibuff_saddr;	/* For our DMA queue.  */
+
+	uint64_t tc_l2c_tad_prf;
+	unsigned tc_l2c_tads;
+	uint64_t tc_l2c_tadx_pfc[4][4];
+
+	uint64_t tc_lmc_reset_ctl;
+	unsigned tc_lmcs;
+	uint64_t tc_lmcx_ops_cnt[4];
+	uint64_t tc_lmcx_ifb_cnt[4];
+	uint64_t tc_lmcx_dclk_cnt[4];
+
+	uint64_t tc_mio_boot_loc_cfg;
+	uint64_t tc_mio_fus_rcmd;
+	uint64_t tc_mio_twsx_sw_twsi[2];
+	uint64_t tc_mio_twsx_sw_twsi_ext[2];
+
+	uint64_t tc_pem_bar1_index;		/* Our BAR1 index entry.  */
 };
 
 struct target {
-	const char *t_model;
+	const struct target_model *t_model;
 	unsigned t_unit;
 
-	uint32_t t_pci_domain;
-	uint8_t t_pci_bus;
-	uint8_t t_pci_slot;
-	uint8_t t_pci_function;
+	struct host_pci_dev t_pci;
 
 	struct target_bar t_pci_bar[TARGET_BARS];
+	bool t_bar0_mmio64;
 
 	uint8_t t_pcie_port;
+	struct target_link t_link;
 
 	uint32_t t_chip_id;
 	uint64_t t_core_mask;
 
 	uint16_t t_board_type;
+
+	/* Fuse bytes read so far, and a bitmap of which those are.  */
+	uint8_t t_fuses[TARGET_FUSE_BYTES];
+	uint64_t t_fuses_valid[TARGET_FUSE_BYTES / 64];
+
+	struct target_csrs t_csrs;
+
+	int t_lock_fd;			/* Lock file, or -1.  */
+
+	uint64_t t_bar1_page;		/* Target page in our BAR1 index entry.  */
+	struct target_dma *t_dma;
+	struct target_mbox *t_mbox;
+	struct target_twsi *t_twsi;
 };
 
+/*
+ * A set of target units, as a bitset which grows on demand.  Iteration
+ * with TARGET_SELECTOR_FOREACH skips over clear words a word at a time,
+ * so sparse selections of large tables remain cheap to walk.
+ */
 struct target_selector {
-	uint32_t ts_mask;
+	unsigned ts_words;
+	uint64_t *ts_mask;
 };
 
-#define	TARGET_SELECT(ts, n)		((ts)->ts_mask |= 1u << (n))
-#define	TARGET_SELECTED(ts, n)		(((ts)->ts_mask & 1u << (n)) != 0)
-#define	TARGET_SELECTED_COUNT(ts)	(__builtin_popcount((ts)->ts_mask))
-#define	TARGET_SELECTOR_EMPTY(ts)	((ts)->ts_mask == 0)
-#define	TARGET_SELECTOR_CLEAR(ts)	((ts)->ts_mask = 0)
-#define	TARGET_SELECTOR_COUNT		(32)
+#define	TARGET_SELECTOR_END		(~0u)
+
+#define	TARGET_SELECT(ts, n)		target_selector_set((ts), (n))
+#define	TARGET_SELECTED(ts, n)		target_selector_isset((ts), (n))
+#define	TARGET_SELECTED_COUNT(ts)	target_selector_count((ts))
+#define	TARGET_SELECTOR_EMPTY(ts)					\
+	(target_selector_next((ts), 0) == TARGET_SELECTOR_END)
+#define	TARGET_SELECTOR_CLEAR(ts)	target_selector_clear((ts))
+#define	TARGET_SELECTOR_FOREACH(ts, n)					\
+	for ((n) = target_selector_next((ts), 0);			\
+	     (n) != TARGET_SELECTOR_END;				\
+	     (n) = target_selector_next((ts), (n) + 1))
+
+/* Selectors.  */
+void target_selector_init(struct target_selector *);
+void target_selector_fini(struct target_selector *);
+void target_selector_copy(struct target_selector *, const struct target_selector *);
+void target_selector_clear(struct target_selector *);
+void target_selector_set(struct target_selector *, unsigned);
+bool target_selector_isset(const struct target_selector *, unsigned);
+unsigned target_selector_count(const struct target_selector *);
+unsigned target_selector_next(const struct target_selector *, unsigned);
+void target_selector_parse(struct target_selector *, const struct target_selector *, const char *);
 
 /* Configuration.  */
-struct target_selector target_identify(void);
+extern bool target_bar1_write_combining;
+extern uint64_t target_dma_scratch;
+
+void target_identify(struct target_selector *);
 
 /* High-level operations.  */
+void target_apply(const struct target_selector *, const struct apply_state *, unsigned, bool);
 void target_boot(const struct target_selector *);
+void target_call(const struct target_selector *, const struct mbox_msg *, unsigned);
+void target_cores(const struct target_selector *, const struct target_cores_req *);
+void target_console(const struct target_selector *, unsigned, const char *);
+void target_csr(const struct target_selector *, const struct csr_op *, unsigned);
+void target_fuses(const struct target_selector *);
+void target_mem_dump(const struct target_selector *, uint64_t, uint64_t, const char *);
+void target_mem_load(const struct target_selector *, uint64_t, const char *);
+void target_profile(const struct target_selector *, unsigned, unsigned, const char *);
 void target_reset(const struct target_selector *);
-void target_show(const struct target_selector *);
+void target_show(const struct target_selector *, bool);
+void target_twsi(const struct target_selector *, const struct twsi_op *);
 
 /* Low-level operations.  */
 uint64_t target_read_csr(const struct target *, uint64_t);
+void target_read_csr_batch(const struct target *, const uint64_t *, uint64_t *, unsigned);
+uint64_t target_read_sli(const struct target *, uint64_t);
 void target_write_csr(const struct target *, uint64_t, uint64_t);
+void target_write_sli(const struct target *, uint64_t, uint64_t);
+void target_bar1_read(const struct target *, uint64_t, void *, size_t);
+void target_bar1_write(const struct target *, uint64_t, const void *, size_t);
+void target_mem_read(struct target *, uint64_t, void *, size_t);
+void target_mem_write(struct target *, uint64_t, const void *, size_t);
+uint32_t target_mem_read4(struct target *, uint64_t);
+uint64_t target_mem_read8(struct target *, uint64_t);
+void target_mem_write4(struct target *, uint64_t, uint32_t);
+void target_mem_write8(struct target *, uint64_t, uint64_t);
 
 #endif /* !TARGET_H */
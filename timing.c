@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "timing.h"
+
+#ifndef	howmany
+#define	howmany(a)	(sizeof (a) / sizeof *(a))
+#endif
+
+struct timing_unit {
+	bool tu_attached;
+	uint64_t tu_total;
+	uint64_t tu_phase[TIMING_PHASES];
+};
+
+enum timing_format timing_format = TIMING_NONE;
+
+static const char *timing_phase_names[TIMING_PHASES] = {
+	[TIMING_LOCK] = "lock",
+	[TIMING_LINK] = "link",
+	[TIMING_BAR] = "bar",
+	[TIMING_MAP] = "map",
+	[TIMING_SLI] = "sli",
+	[TIMING_FUSE] = "fuse",
+	[TIMING_TWSI] = "twsi",
+	[TIMING_EEPROM] = "eeprom",
+};
+
+static struct timing_unit *timing_units;
+static unsigned timing_nunits;
+
+static struct timing_unit *timing_unit(unsigned);
+
+uint64_t
+timing_start(void)
+{
+	if (timing_format == TIMING_NONE)
+		return (0);
+	return (timing_now());
+}
+
+void
+timing_phase(unsigned unit, enum timing_phase phase, uint64_t start)
+{
+	if (timing_format == TIMING_NONE)
+		return;
+	timing_unit(unit)->tu_phase[phase] += timing_now() - start;
+}
+
+void
+timing_attach(unsigned unit, uint64_t start)
+{
+	struct timing_unit *tu;
+
+	if (timing_format == TIMING_NONE)
+		return;
+	tu = timing_unit(unit);
+	tu->tu_attached = true;
+	tu->tu_total = timing_now() - start;
+}
+
+/*
+ * Print the time taken by each phase for each target, and the whole
+ * of identification broken down by phase, largest first, on standard
+ * error so as not to mix with a command's output.  Whatever time
+ * was not spent attaching targets was spent enumerating PCI devices,
+ * and attach time outside any phase is counted as other.
+ */
+void
+timing_report(uint64_t total)
+{
+	uint64_t attach, enumerate, phases, sums[TIMING_PHASES + 2];
+	unsigned i, j, order[TIMING_PHASES + 2], tmp;
+	const char *names[TIMING_PHASES + 2];
+	struct timing_unit *tu;
+	bool first;
+
+	if (timing_format == TIMING_NONE)
+		return;
+
+	memset(sums, 0, sizeof sums);
+	attach = 0;
+	for (i = 0; i < timing_nunits; i++) {
+		tu = &timing_units[i];
+		if (!tu->tu_attached)
+			continue;
+		attach += tu->tu_total;
+		for (j = 0; j < TIMING_PHASES; j++)
+			sums[j] += tu->tu_phase[j];
+	}
+	enumerate = total > attach ? total - attach : 0;
+
+	phases = 0;
+	for (j = 0; j < TIMING_PHASES; j++) {
+		names[j] = timing_phase_names[j];
+		phases += sums[j];
+	}
+	names[TIMING_PHASES] = "enumerate";
+	sums[TIMING_PHASES] = enumerate;
+	names[TIMING_PHASES + 1] = "other";
+	sums[TIMING_PHASES + 1] = attach > phases ? attach - phases : 0;
+
+	for (j = 0; j < howmany(order); j++)
+		order[j] = j;
+	for (i = 1; i < howmany(order); i++) {
+		for (j = i; j > 0 && sums[order[j]] > sums[order[j - 1]]; j--) {
+			tmp = order[j];
+			order[j] = order[j - 1];
+			order[j - 1] = tmp;
+		}
+	}
+
+	if (timing_format == TIMING_TEXT) {
+		fprintf(stderr, "startup: %ju us, enumerate %ju us, attach %ju us\n",
+		    (uintmax_t)total, (uintmax_t)enumerate, (uintmax_t)attach);
+		for (i = 0; i < timing_nunits; i++) {
+			tu = &timing_units[i];
+			if (!tu->tu_attached)
+				continue;
+			fprintf(stderr, "target%u: attach %ju us:", i, (uintmax_t)tu->tu_total);
+			for (j = 0; j < TIMING_PHASES; j++)
+				fprintf(stderr, " %s %ju", names[j], (uintmax_t)tu->tu_phase[j]);
+			fprintf(stderr, "\n");
+		}
+		fprintf(stderr, "critical path:\n");
+		for (i = 0; i < howmany(order); i++) {
+			j = order[i];
+			fprintf(stderr, "    %-10s %10ju us %5.1f%%\n", names[j], (uintmax_t)sums[j],
+			    total == 0 ? 0.0 : 100.0 * sums[j] / total);
+		}
+		return;
+	}
+
+	fprintf(stderr, "{\"total_us\":%ju,\"enumerate_us\":%ju,\"attach_us\":%ju,\"targets\":[",
+	    (uintmax_t)total, (uintmax_t)enumerate, (uintmax_t)attach);
+	first = true;
+	for (i = 0; i < timing_nunits; i++) {
+		tu = &timing_units[i];
+		if (!tu->tu_attached)
+			continue;
+		fprintf(stderr, "%s{\"unit\":%u,\"attach_us\":%ju,\"phases\":{", first ? "" : ",",
+		    i, (uintmax_t)tu->tu_total);
+		first = false;
+		for (j = 0; j < TIMING_PHASES; j++)
+			fprintf(stderr, "%s\"%s\":%ju", j == 0 ? "" : ",", names[j], (uintmax_t)tu->tu_phase[j]);
+		fprintf(stderr, "}}");
+	}
+	fprintf(stderr, "],\"critical_path\":[");
+	for (i = 0; i < howmany(order); i++) {
+		j = order[i];
+		fprintf(stderr, "%s{\"phase\":\"%s\",\"us\":%ju}", i == 0 ? "" : ",", names[j], (uintmax_t)sums[j]);
+	}
+	fprintf(stderr, "]}\n");
+}
+
+static struct timing_unit *
+timing_unit(unsigned unit)
+{
+	struct timing_unit *units;
+	unsigned n;
+
+	if (unit >= timing_nunits) {
+		n = timing_nunits == 0 ? 16 : timing_nunits;
+		while (n <= unit)
+			n *= 2;
+		units = reallocarray(timing_units, n, sizeof *units);
+		if (units == NULL)
+			err(1, "reallocarray");
+		memset(&units[timing_nunits], 0, (n - timing_nunits) * sizeof *units);
+		timing_units = units;
+		timing_nunits = n;
+	}
+	return (&timing_units[unit]);
+}
+
+uint64_t
+timing_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
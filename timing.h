@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#ifndef	TIMING_H
+#define	TIMING_H
+
+/*
+ * Timing of the phases of target identification, reported once all
+ * targets are attached.  Targets are attached one after another, so
+ * the critical path through startup is PCI enumeration followed by
+ * every phase of every attach; the report ranks phases by their
+ * share of it.
+ */
+enum timing_format {
+	TIMING_NONE,
+	TIMING_TEXT,
+	TIMING_JSON,
+};
+
+enum timing_phase {
+	TIMING_LOCK,		/* Opening the lock file.  */
+	TIMING_LINK,		/* Reading PCIe configuration space.  */
+	TIMING_BAR,		/* Describing BARs.  */
+	TIMING_MAP,		/* Mapping BARs.  */
+	TIMING_SLI,		/* SLI register reads and CSR resolution.  */
+	TIMING_FUSE,		/* Reading CIU_FUSE.  */
+	TIMING_TWSI,		/* Setting up the TWSI buses.  */
+	TIMING_EEPROM,		/* Scanning for the board EEPROM.  */
+	TIMING_PHASES
+};
+
+extern enum timing_format timing_format;
+
+/*
+ * A timestamp in microseconds for starting a phase, or zero if
+ * timing is not enabled.
+ */
+uint64_t timing_start(void);
+
+/*
+ * The monotonic clock in microseconds, for timeouts and intervals
+ * throughout.
+ */
+uint64_t timing_now(void);
+void timing_phase(unsigned, enum timing_phase, uint64_t);
+void timing_attach(unsigned, uint64_t);
+void timing_report(uint64_t);
+
+#endif /* !TIMING_H */
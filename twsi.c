@@ -0,0 +1,410 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <err.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <cvmx.h>
+#include <cvmx-clock.h>
+
+#include "host.h"
+#include "lock.h"
+#include "target.h"
+#include "timing.h"
+#include "twsi.h"
+
+#define	TWSI_TIMEOUT		(100000)	/* Microseconds.  */
+#define	TWSI_WRITE_CYCLE	(10000)		/* Microseconds.  */
+#define	TWSI_RETRY_DELAY	(1000)		/* Microseconds.  */
+
+/*
+ * Reads used to check a bus at TWSI_HZ_FAST, each compared with a
+ * read of the same bytes at TWSI_HZ_SLOW.
+ */
+#define	TWSI_NEGOTIATE_READS	(2)
+
+/*
+ * The bus clock is SCLK / (20 * (THP + 1) * (M + 1) * 2^N), where THP
+ * is the TCLK half-period, which we leave at its reset value, and M
+ * and N are set through the controller's CLKCTL register.
+ */
+#define	TWSI_THP		(24)
+#define	TWSI_OP_CLKCTL		(0x6)
+#define	TWSI_EOP_CLKCTL		(0x3)
+
+/*
+ * High-level engine operations.
+ */
+#define	TWSI_OP_7		(0x0)	/* 7-bit address, no internal address.  */
+#define	TWSI_OP_7_IA		(0x1)	/* 7-bit address, internal address.  */
+
+struct target_twsi {
+	uint64_t tt_sclk;
+	unsigned tt_hz[TWSI_BUSES];
+
+	/*
+	 * After a write, an EEPROM ignores its address until its write
+	 * cycle is over, so until then a transaction to the device last
+	 * written on each bus which is not acknowledged is retried,
+	 * every TWSI_RETRY_DELAY, rather than failed.
+	 */
+	uint64_t tt_busy_until[TWSI_BUSES];
+	uint8_t tt_busy_dev[TWSI_BUSES];
+};
+
+static void target_twsi_clock(struct target *, struct target_twsi *, unsigned, unsigned);
+static bool target_twsi_transfer(struct target *, struct target_twsi *, bool, unsigned, uint8_t, unsigned, uint16_t, uint8_t *, size_t);
+static bool target_twsi_exec(struct target *, struct target_twsi *, unsigned, uint64_t, const uint64_t *, unsigned, uint64_t *, uint64_t *);
+static void target_twsi_sleep(uint64_t);
+
+void
+target_twsi_attach(struct target *t)
+{
+	struct target_twsi *tt;
+	unsigned bus;
+
+	tt = calloc(1, sizeof *tt);
+	if (tt == NULL)
+		err(1, "calloc");
+	tt->tt_sclk = cvmx_clock_get_rate(CVMX_CLOCK_SCLK);
+	t->t_twsi = tt;
+
+	target_lock(t, TARGET_LOCK_TWSI);
+	for (bus = 0; bus < TWSI_BUSES; bus++)
+		target_twsi_clock(t, tt, bus, TWSI_HZ_SLOW);
+	target_unlock(t, TARGET_LOCK_TWSI);
+}
+
+/*
+ * Find the fastest clock at which a device on a bus can be read
+ * reliably, by reading from it at TWSI_HZ_SLOW and then checking that
+ * reads at TWSI_HZ_FAST succeed and return the same bytes.  The bus is
+ * left at the clock chosen, which is returned.
+ */
+unsigned
+target_twsi_negotiate(struct target *t, unsigned bus, uint8_t dev, unsigned iawidth, uint16_t ia)
+{
+	uint8_t fast[TWSI_XFER_MAX], slow[TWSI_XFER_MAX];
+	struct target_twsi *tt;
+	unsigned hz, i;
+	bool ok;
+
+	tt = t->t_twsi;
+
+	target_lock(t, TARGET_LOCK_TWSI);
+	target_twsi_clock(t, tt, bus, TWSI_HZ_SLOW);
+	if (target_twsi_transfer(t, tt, false, bus, dev, iawidth, ia, slow, sizeof slow)) {
+		target_twsi_clock(t, tt, bus, TWSI_HZ_FAST);
+		ok = true;
+		for (i = 0; ok && i < TWSI_NEGOTIATE_READS; i++) {
+			ok = target_twsi_transfer(t, tt, false, bus, dev, iawidth, ia, fast, sizeof fast) &&
+			    memcmp(fast, slow, sizeof fast) == 0;
+		}
+		if (!ok)
+			target_twsi_clock(t, tt, bus, TWSI_HZ_SLOW);
+	}
+	hz = tt->tt_hz[bus];
+	target_unlock(t, TARGET_LOCK_TWSI);
+
+	return (hz);
+}
+
+void
+target_twsi_slow(struct target *t, unsigned bus)
+{
+	target_lock(t, TARGET_LOCK_TWSI);
+	target_twsi_clock(t, t->t_twsi, bus, TWSI_HZ_SLOW);
+	target_unlock(t, TARGET_LOCK_TWSI);
+}
+
+unsigned
+target_twsi_hz(const struct target *t, unsigned bus)
+{
+	return (t->t_twsi->tt_hz[bus]);
+}
+
+bool
+target_twsi_read(struct target *t, unsigned bus, uint8_t dev, unsigned iawidth, uint16_t ia, void *data, size_t len)
+{
+	bool ok;
+
+	target_lock(t, TARGET_LOCK_TWSI);
+	ok = target_twsi_transfer(t, t->t_twsi, false, bus, dev, iawidth, ia, data, len);
+	target_unlock(t, TARGET_LOCK_TWSI);
+
+	return (ok);
+}
+
+bool
+target_twsi_write(struct target *t, unsigned bus, uint8_t dev, unsigned iawidth, uint16_t ia, const void *data, size_t len)
+{
+	uint8_t buf[TWSI_IO_MAX];
+	bool ok;
+
+	if (len > sizeof buf)
+		errx(1, "TWSI write of %zu bytes too long.", len);
+	memcpy(buf, data, len);
+
+	target_lock(t, TARGET_LOCK_TWSI);
+	ok = target_twsi_transfer(t, t->t_twsi, true, bus, dev, iawidth, ia, buf, len);
+	target_unlock(t, TARGET_LOCK_TWSI);
+
+	return (ok);
+}
+
+/*
+ * The bus runs at the clock asked for only for the transfer, under
+ * the same lock, and the clock it actually got is reported.
+ */
+void
+target_twsi_run(struct target *t, const struct twsi_op *to)
+{
+	uint8_t data[TWSI_IO_MAX];
+	struct target_twsi *tt;
+	size_t i, j;
+	bool ok;
+
+	tt = t->t_twsi;
+	if (to->to_write)
+		memcpy(data, to->to_data, to->to_len);
+
+	target_lock(t, TARGET_LOCK_TWSI);
+	target_twsi_clock(t, tt, to->to_bus, to->to_hz);
+	printf("target%u: TWSI%u clock %u kHz\n", t->t_unit, to->to_bus, tt->tt_hz[to->to_bus] / 1000);
+	ok = target_twsi_transfer(t, tt, to->to_write, to->to_bus, to->to_dev, to->to_iawidth, to->to_ia, data, to->to_len);
+	target_twsi_clock(t, tt, to->to_bus, TWSI_HZ_SLOW);
+	target_unlock(t, TARGET_LOCK_TWSI);
+
+	if (!ok)
+		errx(1, "target%u: TWSI%u %s device %#x failed.", t->t_unit, to->to_bus, to->to_write ? "write to" : "read from", to->to_dev);
+	if (to->to_write)
+		return;
+
+	for (i = 0; i < to->to_len; i += 16) {
+		printf("target%u: %04zx:", t->t_unit, to->to_ia + i);
+		for (j = i; j < to->to_len && j < i + 16; j++)
+			printf(" %02x", data[j]);
+		printf("\n");
+	}
+}
+
+/*
+ * Program a bus for the fastest clock no faster than hz, taking the
+ * smallest N for which M fits in its four bits.
+ */
+static void
+target_twsi_clock(struct target *t, struct target_twsi *tt, unsigned bus, unsigned hz)
+{
+	cvmx_mio_tws_sw_twsi_t mtst;
+	uint64_t base, div, result;
+	unsigned m, nexp;
+
+	base = 20 * (TWSI_THP + 1);
+	div = (tt->tt_sclk + base * hz - 1) / (base * hz);
+	for (nexp = 0; nexp < 7 && div > (16u << nexp); nexp++)
+		continue;
+	m = (div + (1u << nexp) - 1) >> nexp;
+	if (m == 0)
+		m = 1;
+	else if (m > 16)
+		m = 16;
+
+	mtst.u64 = 0;
+	mtst.s.v = 1;
+	mtst.s.op = TWSI_OP_CLKCTL;
+	mtst.s.eop_ia = TWSI_EOP_CLKCTL;
+	mtst.s.d = ((m - 1) << 3) | nexp;
+
+	/*
+	 * Until the rate is known, estimate completion times from
+	 * the slowest clock we could be setting.
+	 */
+	tt->tt_hz[bus] = TWSI_HZ_SLOW;
+	(void)target_twsi_exec(t, tt, bus, mtst.u64, NULL, 1, &result, NULL);
+
+	tt->tt_hz[bus] = tt->tt_sclk / (base * (m << nexp));
+	if (tt->tt_hz[bus] == 0)
+		tt->tt_hz[bus] = 1;
+}
+
+/*
+ * Move len bytes between data and a device, as many transactions of
+ * up to TWSI_XFER_MAX bytes.  Writes are split at multiples of
+ * TWSI_XFER_MAX in the internal address, so that none crosses an
+ * EEPROM page.  Called with TARGET_LOCK_TWSI held.
+ */
+static bool
+target_twsi_transfer(struct target *t, struct target_twsi *tt, bool write, unsigned bus, uint8_t dev, unsigned iawidth, uint16_t ia, uint8_t *data, size_t len)
+{
+	cvmx_mio_tws_sw_twsi_ext_t mtste;
+	cvmx_mio_tws_sw_twsi_t mtst;
+	uint64_t ext, lo, hi;
+	unsigned bytes, i;
+	size_t chunk;
+	bool useext;
+
+	while (len != 0) {
+		chunk = len < TWSI_XFER_MAX ? len : TWSI_XFER_MAX;
+		if (write && iawidth != 0 &&
+		    chunk > (size_t)(TWSI_XFER_MAX - ia % TWSI_XFER_MAX))
+			chunk = TWSI_XFER_MAX - ia % TWSI_XFER_MAX;
+
+		mtst.u64 = 0;
+		mtst.s.v = 1;
+		mtst.s.r = !write;
+		mtst.s.sovr = 1;
+		mtst.s.size = chunk - 1;
+		mtst.s.a = dev;
+		mtste.u64 = 0;
+
+		/*
+		 * The bytes on the bus: the device address, the internal
+		 * address, the device address again before a read of
+		 * an internal address, and the data.
+		 */
+		bytes = 1 + iawidth / 8 + chunk;
+		if (iawidth == 0) {
+			mtst.s.op = TWSI_OP_7;
+		} else {
+			mtst.s.op = TWSI_OP_7_IA;
+			mtst.s.ia = (ia >> 3) & 0x1f;
+			mtst.s.eop_ia = ia & 0x7;
+			if (iawidth == 16) {
+				mtst.s.eia = 1;
+				mtste.s.ia = ia >> 8;
+			}
+			if (!write)
+				bytes++;
+		}
+
+		/*
+		 * The last four bytes of the data are in SW_TWSI[D],
+		 * the last at the bottom, and any before them are in
+		 * SW_TWSI_EXT[D].
+		 */
+		if (write) {
+			lo = hi = 0;
+			for (i = 0; i < chunk; i++) {
+				if (chunk - 1 - i < 4)
+					lo |= (uint64_t)data[i] << (8 * (chunk - 1 - i));
+				else
+					hi |= (uint64_t)data[i] << (8 * (chunk - 5 - i));
+			}
+			mtst.s.d = lo;
+			mtste.s.d = hi;
+		}
+		useext = iawidth == 16 || chunk > 4;
+		ext = mtste.u64;
+
+		for (;;) {
+			if (target_twsi_exec(t, tt, bus, mtst.u64, useext ? &ext : NULL, bytes, &lo, chunk > 4 && !write ? &hi : NULL))
+				break;
+			if (dev != tt->tt_busy_dev[bus] ||
+			    timing_now() >= tt->tt_busy_until[bus])
+				return (false);
+			target_twsi_sleep(TWSI_RETRY_DELAY);
+		}
+
+		if (write) {
+			tt->tt_busy_until[bus] = timing_now() + TWSI_WRITE_CYCLE;
+			tt->tt_busy_dev[bus] = dev;
+		} else {
+			for (i = 0; i < chunk; i++) {
+				if (chunk - 1 - i < 4)
+					data[i] = lo >> (8 * (chunk - 1 - i));
+				else
+					data[i] = hi >> (8 * (chunk - 5 - i));
+			}
+		}
+
+		ia += chunk;
+		data += chunk;
+		len -= chunk;
+	}
+	return (true);
+}
+
+/*
+ * Start a transaction and wait for the engine to finish it.  A byte
+ * takes nine bus clocks, so rather than polling SW_TWSI across PCIe
+ * for the whole transaction, sleep until it should be about done
+ * before the first poll.  Where the result extends into SW_TWSI_EXT,
+ * each poll reads both registers in one batch.  Returns whether the
+ * engine reported success, with the registers' final values.
+ */
+static bool
+target_twsi_exec(struct target *t, struct target_twsi *tt, unsigned bus, uint64_t cmd, const uint64_t *ext, unsigned bytes, uint64_t *resultp, uint64_t *extp)
+{
+	cvmx_mio_tws_sw_twsi_ext_t mtste;
+	uint64_t addrs[2], vals[2];
+	cvmx_mio_tws_sw_twsi_t mtst;
+	uint64_t deadline, due, now;
+
+	addrs[0] = t->t_csrs.tc_mio_twsx_sw_twsi[bus];
+	addrs[1] = t->t_csrs.tc_mio_twsx_sw_twsi_ext[bus];
+
+	if (ext != NULL)
+		target_write_csr(t, addrs[1], *ext);
+	target_write_csr(t, addrs[0], cmd);
+
+	now = timing_now();
+	due = now + (uint64_t)bytes * 9 * 1000000 / tt->tt_hz[bus];
+	deadline = now + TWSI_TIMEOUT;
+	target_twsi_sleep(due - now);
+
+	for (;;) {
+		target_read_csr_batch(t, addrs, vals, extp != NULL ? 2 : 1);
+		mtst.u64 = vals[0];
+		if (!mtst.s.v)
+			break;
+		if (timing_now() >= deadline)
+			errx(1, "target%u: TWSI%u transaction timed out.", t->t_unit, bus);
+	}
+
+	*resultp = mtst.s.d;
+	if (extp != NULL) {
+		mtste.u64 = vals[1];
+		*extp = mtste.s.d;
+	}
+	return (mtst.s.r);
+}
+
+static void
+target_twsi_sleep(uint64_t us)
+{
+	struct timespec ts;
+
+	ts.tv_sec = us / 1000000;
+	ts.tv_nsec = (long)(us % 1000000) * 1000;
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+		continue;
+}
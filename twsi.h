@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2015-2016 Juli Mallett. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#ifndef	TWSI_H
+#define	TWSI_H
+
+struct target;
+
+/*
+ * Transactions on the target's TWSI (I2C) buses, run by the
+ * controllers' high-level engine through MIO_TWS*_SW_TWSI and
+ * MIO_TWS*_SW_TWSI_EXT.  Each engine transaction moves up to
+ * TWSI_XFER_MAX bytes, and an internal (register or memory) address
+ * of 8 or 16 bits is sent in the same transaction as the data, so a
+ * read of an EEPROM costs one transaction per eight bytes rather
+ * than four per byte.  Longer transfers are split, advancing the
+ * internal address.
+ *
+ * Each bus starts at TWSI_HZ_SLOW.  Once a device is known to be
+ * present, target_twsi_negotiate tries TWSI_HZ_FAST and keeps it only
+ * if reads from that device succeed and match at both speeds.  Other
+ * devices on the bus may not manage the faster clock, so whoever
+ * raises it returns the bus to TWSI_HZ_SLOW when done with the device.
+ */
+#define	TWSI_BUSES		(2)
+#define	TWSI_XFER_MAX		(8)
+#define	TWSI_IO_MAX		(256)	/* Largest transfer from the command line.  */
+
+#define	TWSI_HZ_MIN		(10000)
+#define	TWSI_HZ_SLOW		(100000)
+#define	TWSI_HZ_FAST		(400000)
+
+/*
+ * A transfer given on the command line.  to_iawidth is the width of
+ * the internal address in bits, 0, 8 or 16, and to_hz the clock to
+ * run the bus at for the transfer.
+ */
+struct twsi_op {
+	bool to_write;
+	unsigned to_hz;
+	unsigned to_bus;
+	uint8_t to_dev;
+	unsigned to_iawidth;
+	uint16_t to_ia;
+	size_t to_len;
+	uint8_t to_data[TWSI_IO_MAX];
+};
+
+/*
+ * Set the clock on each bus to TWSI_HZ_SLOW.  The target must be
+ * selected, so that the SDK can find its SCLK rate.
+ */
+void target_twsi_attach(struct target *);
+unsigned target_twsi_negotiate(struct target *, unsigned, uint8_t, unsigned, uint16_t);
+void target_twsi_slow(struct target *, unsigned);
+unsigned target_twsi_hz(const struct target *, unsigned);
+
+bool target_twsi_read(struct target *, unsigned, uint8_t, unsigned, uint16_t, void *, size_t);
+bool target_twsi_write(struct target *, unsigned, uint8_t, unsigned, uint16_t, const void *, size_t);
+
+void target_twsi_run(struct target *, const struct twsi_op *);
+
+#endif /* !TWSI_H */